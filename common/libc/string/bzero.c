@@ -49,28 +49,47 @@ void
 bzero(void *vblock, size_t len)
 {
 	char *block = vblock;
-	size_t i;
+	long *lb;
 
 	/*
-	 * For performance, optimize the common case where the pointer
-	 * and the length are word-aligned, and write word-at-a-time
-	 * instead of byte-at-a-time. Otherwise, write bytes.
+	 * For performance, write word-at-a-time: bytes up to the first
+	 * word boundary, then eight words per loop iteration, then any
+	 * remaining words, then any remaining bytes. Short blocks go
+	 * straight to the byte loop.
 	 *
 	 * The alignment logic here should be portable. We rely on the
 	 * compiler to be reasonably intelligent about optimizing the
 	 * divides and moduli out. Fortunately, it is.
 	 */
 
-	if ((uintptr_t)block % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
-		long *lb = (long *)block;
-		for (i=0; i<len/sizeof(long); i++) {
-			lb[i] = 0;
+	if (len >= 4*sizeof(long)) {
+		while ((uintptr_t)block % sizeof(long) != 0) {
+			*block++ = 0;
+			len--;
 		}
-	}
-	else {
-		for (i=0; i<len; i++) {
-			block[i] = 0;
+
+		lb = (long *)block;
+		while (len >= 8*sizeof(long)) {
+			lb[0] = 0;
+			lb[1] = 0;
+			lb[2] = 0;
+			lb[3] = 0;
+			lb[4] = 0;
+			lb[5] = 0;
+			lb[6] = 0;
+			lb[7] = 0;
+			lb += 8;
+			len -= 8*sizeof(long);
+		}
+		while (len >= sizeof(long)) {
+			*lb++ = 0;
+			len -= sizeof(long);
 		}
+		block = (char *)lb;
+	}
+
+	while (len > 0) {
+		*block++ = 0;
+		len--;
 	}
 }
@@ -47,39 +47,71 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d = dst;
+	const char *s = src;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * For speedy copying, copy word-at-a-time whenever the two
+	 * pointers are equally aligned: copy bytes up to the first
+	 * word boundary, then eight words per loop iteration, then
+	 * any remaining words, then any remaining bytes. Short copies
+	 * aren't worth the setup. If the pointers are aligned
+	 * differently, no word load lines up with a word store, so
+	 * copy by bytes, unrolled.
 	 *
 	 * The alignment logic below should be portable. We rely on
 	 * the compiler to be reasonably intelligent about optimizing
 	 * the divides and modulos out. Fortunately, it is.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	if (len >= 4*sizeof(long) &&
+	    ((uintptr_t)d - (uintptr_t)s) % sizeof(long) == 0) {
+		long *ld;
+		const long *ls;
 
-		long *d = dst;
-		const long *s = src;
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*d++ = *s++;
+			len--;
+		}
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		ld = (long *)d;
+		ls = (const long *)s;
+		while (len >= 8*sizeof(long)) {
+			ld[0] = ls[0];
+			ld[1] = ls[1];
+			ld[2] = ls[2];
+			ld[3] = ls[3];
+			ld[4] = ls[4];
+			ld[5] = ls[5];
+			ld[6] = ls[6];
+			ld[7] = ls[7];
+			ld += 8;
+			ls += 8;
+			len -= 8*sizeof(long);
+		}
+		while (len >= sizeof(long)) {
+			*ld++ = *ls++;
+			len -= sizeof(long);
 		}
+		d = (char *)ld;
+		s = (const char *)ls;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
-		}
+	while (len >= 4) {
+		d[0] = s[0];
+		d[1] = s[1];
+		d[2] = s[2];
+		d[3] = s[3];
+		d += 4;
+		s += 4;
+		len -= 4;
+	}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
@@ -41,6 +41,7 @@
 #include <syscall.h>
 #include <addrspace.h>
 #include <proc.h>
+#include <ktrace.h>
 #include "opt-A3.h"
 
 
@@ -188,10 +189,13 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_fromuser;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		old_fromuser = curthread->t_intr_fromuser;
+		curthread->t_intr_fromuser = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -230,6 +234,7 @@ mips_trap(struct trapframe *tf)
 			curthread->t_curspl = 0;
 		}
 
+		curthread->t_intr_fromuser = old_fromuser;
 		curthread->t_in_interrupt = old_in;
 		goto done2;
 	}
@@ -268,16 +273,19 @@ mips_trap(struct trapframe *tf)
 	 */
 	switch (code) {
 	case EX_MOD:
+		KTRACE(KT_FAULT, VM_FAULT_READONLY, tf->tf_vaddr, tf->tf_epc);
 		if (vm_fault(VM_FAULT_READONLY, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBL:
+		KTRACE(KT_FAULT, VM_FAULT_READ, tf->tf_vaddr, tf->tf_epc);
 		if (vm_fault(VM_FAULT_READ, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBS:
+		KTRACE(KT_FAULT, VM_FAULT_WRITE, tf->tf_vaddr, tf->tf_epc);
 		if (vm_fault(VM_FAULT_WRITE, tf->tf_vaddr)==0) {
 			goto done;
 		}
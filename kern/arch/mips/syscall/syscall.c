@@ -35,8 +35,24 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
+#include <scstats.h>
+#include <ktrace.h>
 #include "opt-A2.h"
 
+#if OPT_SCSTATS
+/* Read the CP0 cycle counter */
+static inline
+uint32_t
+syscall_cycles(void)
+{
+	uint32_t count;
+
+	__asm volatile("mfc0 %0, $9" : "=r" (count));
+	return count;
+}
+#endif
+
 
 /*
  * System call dispatcher.
@@ -82,6 +98,17 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#if OPT_SCSTATS
+	uint32_t startcycles = syscall_cycles();
+#endif
+#if OPT_A2
+	off_t retval64;
+	bool is64 = false;
+	int whence;
+	off_t pos;
+	int fdesc;
+	struct copyreq stackargs[2];
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -100,6 +127,9 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
+	SCSTATS_ENTER(callno);
+	KTRACE(KT_SYSCALL, callno, tf->tf_a0, tf->tf_a1);
+
 	switch (callno) {
 	case SYS_reboot:
 		err = sys_reboot(tf->tf_a0);
@@ -134,8 +164,118 @@ syscall(struct trapframe *tf)
   case SYS_fork:
     err = sys_fork(tf, (pid_t *)&retval);
     break;
+  case SYS_vfork:
+    err = sys_vfork(tf, (pid_t *)&retval);
+    break;
+  case SYS_wait4:
+    err = sys_wait4((pid_t)tf->tf_a0,
+                    (userptr_t)tf->tf_a1,
+                    (int)tf->tf_a2,
+                    (userptr_t)tf->tf_a3,
+                    (pid_t *)&retval);
+    break;
+  case SYS_getrusage:
+    err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+    break;
   case SYS_execv:
-    err = sys_execv((char *) tf->tf_a0, (char **)tf->tf_a1);
+    err = sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+    break;
+  case SYS_open:
+    err = sys_open((userptr_t)tf->tf_a0,
+                   (int)tf->tf_a1,
+                   (mode_t)tf->tf_a2,
+                   (int *)&retval);
+    break;
+  case SYS_read:
+    err = sys_read((int)tf->tf_a0,
+                   (userptr_t)tf->tf_a1,
+                   (unsigned int)tf->tf_a2,
+                   (int *)&retval);
+    break;
+  case SYS_lseek:
+    /* pos is 64-bit, in a2/a3; whence is on the stack */
+    err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence, sizeof(int));
+    if (err) {
+      break;
+    }
+    err = sys_lseek((int)tf->tf_a0,
+                    ((off_t)tf->tf_a2 << 32) | (uint32_t)tf->tf_a3,
+                    whence,
+                    &retval64);
+    is64 = true;
+    break;
+  case SYS_close:
+    err = sys_close((int)tf->tf_a0);
+    break;
+  case SYS_pipe:
+    err = sys_pipe((userptr_t)tf->tf_a0);
+    break;
+  case SYS_readv:
+    err = sys_readv((int)tf->tf_a0,
+                    (const_userptr_t)tf->tf_a1,
+                    (int)tf->tf_a2,
+                    (int *)&retval);
+    break;
+  case SYS_writev:
+    err = sys_writev((int)tf->tf_a0,
+                     (const_userptr_t)tf->tf_a1,
+                     (int)tf->tf_a2,
+                     (int *)&retval);
+    break;
+  case SYS_pread:
+  case SYS_pwrite:
+  case SYS_preadv:
+  case SYS_pwritev:
+    /* the 64-bit offset comes fourth, so it's on the stack */
+    err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos, sizeof(off_t));
+    if (err) {
+      break;
+    }
+    if (callno == SYS_pread) {
+      err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+                      (unsigned int)tf->tf_a2, pos, (int *)&retval);
+    }
+    else if (callno == SYS_pwrite) {
+      err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+                       (unsigned int)tf->tf_a2, pos, (int *)&retval);
+    }
+    else if (callno == SYS_preadv) {
+      err = sys_preadv((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+                       (int)tf->tf_a2, pos, (int *)&retval);
+    }
+    else {
+      err = sys_pwritev((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+                        (int)tf->tf_a2, pos, (int *)&retval);
+    }
+    break;
+  case SYS_mmap:
+    /* fd is fifth, on the stack; the 64-bit offset is aligned after it */
+    stackargs[0].cr_uaddr = (userptr_t)(tf->tf_sp + 16);
+    stackargs[0].cr_kaddr = &fdesc;
+    stackargs[0].cr_len = sizeof(int);
+    stackargs[1].cr_uaddr = (userptr_t)(tf->tf_sp + 24);
+    stackargs[1].cr_kaddr = &pos;
+    stackargs[1].cr_len = sizeof(off_t);
+    err = copyin_batch(stackargs, 2);
+    if (err) {
+      break;
+    }
+    err = sys_mmap((userptr_t)tf->tf_a0,
+                   (size_t)tf->tf_a1,
+                   (int)tf->tf_a2,
+                   (int)tf->tf_a3,
+                   fdesc,
+                   pos,
+                   &retval);
+    break;
+  case SYS_munmap:
+    err = sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+    break;
+#endif
+#if OPT_SCSTATS
+  case SYS___scstats:
+    err = sys___scstats((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+                        (int *)&retval);
     break;
 #endif
 #endif // UW
@@ -158,6 +298,14 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+#if OPT_A2
+	else if (is64) {
+		/* Success, with a 64-bit result in v0 (high) and v1 (low). */
+		tf->tf_v0 = (uint32_t)(retval64 >> 32);
+		tf->tf_v1 = (uint32_t)retval64;
+		tf->tf_a3 = 0;
+	}
+#endif
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
@@ -171,6 +319,9 @@ syscall(struct trapframe *tf)
 
 	tf->tf_epc += 4;
 
+	SCSTATS_EXIT(callno, err, syscall_cycles() - startcycles);
+	KTRACE(KT_SYSRET, callno, err, retval);
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
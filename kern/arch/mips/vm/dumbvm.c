@@ -37,6 +37,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <mmap.h>
 #include "opt-A3.h"
 
 /*
@@ -57,17 +58,51 @@ static bool coremap_ready = false;
 static unsigned int coremap_size = 0;
 static paddr_t coremap_start = 0;
 static paddr_t coremap_end = 0;
+/*
+ * The coremap (an int per page, then a kpage tag per page) takes up
+ * the first pages of memory; the pages it manages start at
+ * coremap_base.
+ */
+static paddr_t coremap_base = 0;
+static void **coremap_tags = NULL;
+
+/*
+ * Kernel allocations too big to find physically contiguous pages for
+ * are mapped through kseg2 instead, one page at a time. kseg2_map
+ * holds, for each page of the window, the physical page and flags;
+ * vm_fault reads it without locking to load TLB entries, so an entry
+ * is filled in before the pages are handed out and cleared (and the
+ * TLB entry dropped) before the page is freed.
+ *
+ * dumbvm has no TLB shootdown, so like the rest of dumbvm this only
+ * works with one CPU.
+ */
+#define KSEG2_NPAGES  1024            /* 4M of kernel virtual space */
+#define KSEG2_INUSE   0x1             /* entry maps a page */
+#define KSEG2_FIRST   0x2             /* ...which starts an allocation */
+static struct spinlock kseg2_lock = SPINLOCK_INITIALIZER;
+static volatile uint32_t kseg2_map[KSEG2_NPAGES];
 #endif
 
 void
 vm_bootstrap(void)
 {
 #if OPT_A3
+  unsigned int npages, mappages;
+
   ram_getsize(&coremap_start, &coremap_end);
-  coremap_size = (coremap_end - coremap_start) / PAGE_SIZE;
+  npages = (coremap_end - coremap_start) / PAGE_SIZE;
+  mappages = (npages * (sizeof(int) + sizeof(void *)) + PAGE_SIZE - 1)
+    / PAGE_SIZE;
+  coremap_size = npages - mappages;
+  coremap_base = coremap_start + mappages * PAGE_SIZE;
+  coremap_tags = (void **)
+    PADDR_TO_KVADDR(coremap_start + coremap_size * sizeof(int));
+
   unsigned int temp = 0;
   while (temp < coremap_size) {
     ((int *) PADDR_TO_KVADDR(coremap_start))[temp] = 0;
+    coremap_tags[temp] = NULL;
     temp++;
   }
   coremap_ready = true;
@@ -99,7 +134,7 @@ coremap_stealmem(unsigned long numpages)
         unsigned long np = numpages;
         (void)ps;
         (void)np;
-        return (potential_start + 1) * PAGE_SIZE + coremap_start;
+        return potential_start * PAGE_SIZE + coremap_base;
       }
 
       temp++;
@@ -154,15 +189,24 @@ alloc_kpages(int npages)
 	return PADDR_TO_KVADDR(pa);
 }
 
+#if OPT_A3
+static void free_kvpages(vaddr_t addr);
+#endif
+
 void
 free_kpages(vaddr_t addr)
 {
 #if OPT_A3
+  if (addr >= MIPS_KSEG2) {
+    free_kvpages(addr);
+    return;
+  }
+
   paddr_t p_addr = KVADDR_TO_PADDR(addr);
 
   spinlock_acquire(&coremap_lock);
 
-    unsigned int temp = ((p_addr - coremap_start) / PAGE_SIZE) - 1;
+    unsigned int temp = (p_addr - coremap_base) / PAGE_SIZE;
     /* paddr_t cs = coremap_start; */
     /* paddr_t p = p_addr; */
     /* unsigned int sz = coremap_size; */
@@ -171,13 +215,17 @@ free_kpages(vaddr_t addr)
     /* (void) sz; */
     KASSERT(temp < coremap_size);
     ((int*) PADDR_TO_KVADDR(coremap_start))[temp] = 0;
+    coremap_tags[temp] = NULL;
     temp++;
-    int cur = ((int*) PADDR_TO_KVADDR(coremap_start))[temp];
 
-    while (cur != 0 && cur != 1) {
+    while (temp < coremap_size) {
+      int cur = ((int*) PADDR_TO_KVADDR(coremap_start))[temp];
+      if (cur == 0 || cur == 1) {
+        break;
+      }
       ((int*) PADDR_TO_KVADDR(coremap_start))[temp] = 0;
+      coremap_tags[temp] = NULL;
       temp++;
-      cur = ((int*) PADDR_TO_KVADDR(coremap_start))[temp];
     }
 
   spinlock_release(&coremap_lock);
@@ -186,6 +234,298 @@ free_kpages(vaddr_t addr)
 #endif
 }
 
+void
+kpage_settag(vaddr_t kva, void *tag)
+{
+#if OPT_A3
+  paddr_t pa = KVADDR_TO_PADDR(kva);
+
+  /* only kmalloc changes a page's tag, and only while it owns it */
+  if (coremap_ready && pa >= coremap_base &&
+      pa < coremap_base + coremap_size * PAGE_SIZE) {
+    coremap_tags[(pa - coremap_base) / PAGE_SIZE] = tag;
+  }
+#else
+  (void)kva;
+  (void)tag;
+#endif
+}
+
+bool
+kpage_gettag(vaddr_t kva, void **tag)
+{
+#if OPT_A3
+  paddr_t pa = KVADDR_TO_PADDR(kva);
+
+  if (coremap_ready && pa >= coremap_base &&
+      pa < coremap_base + coremap_size * PAGE_SIZE) {
+    *tag = coremap_tags[(pa - coremap_base) / PAGE_SIZE];
+    return true;
+  }
+#else
+  (void)kva;
+  (void)tag;
+#endif
+  return false;
+}
+
+#if OPT_A3
+/*
+ * Drop this CPU's TLB entry for VADDR, if there is one.
+ */
+static
+void
+kseg2_tlbinvalidate(vaddr_t vaddr)
+{
+  int i, spl;
+
+  spl = splhigh();
+  i = tlb_probe(vaddr, 0);
+  if (i >= 0) {
+    tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+  }
+  splx(spl);
+}
+
+/*
+ * Give pages [start, start+npages) of the kseg2 window physical pages.
+ * The first of them starts an allocation if FIRST is set. On failure
+ * nothing is left mapped. Call with kseg2_lock held.
+ */
+static
+bool
+kseg2_mappages(unsigned start, unsigned npages, bool first)
+{
+  unsigned i;
+  paddr_t pa;
+
+  for (i = start; i < start + npages; i++) {
+    KASSERT(kseg2_map[i] == 0);
+    pa = getppages(1);
+    if (pa == 0) {
+      while (i-- > start) {
+        pa = kseg2_map[i] & PAGE_FRAME;
+        kseg2_map[i] = 0;
+        kseg2_tlbinvalidate(MIPS_KSEG2 + i * PAGE_SIZE);
+        free_kpages(PADDR_TO_KVADDR(pa));
+      }
+      return false;
+    }
+    kseg2_map[i] = pa | KSEG2_INUSE;
+  }
+  if (first) {
+    kseg2_map[start] |= KSEG2_FIRST;
+  }
+  return true;
+}
+#endif
+
+/*
+ * Allocate NPAGES of kernel memory that is virtually but not
+ * necessarily physically contiguous.
+ */
+vaddr_t
+alloc_kvpages(unsigned npages)
+{
+#if OPT_A3
+  unsigned start, run, i;
+
+  if (!coremap_ready || npages == 0 || npages > KSEG2_NPAGES) {
+    return 0;
+  }
+
+  spinlock_acquire(&kseg2_lock);
+  run = 0;
+  start = 0;
+  for (i = 0; i < KSEG2_NPAGES && run < npages; i++) {
+    if (kseg2_map[i] != 0) {
+      run = 0;
+      start = i + 1;
+    }
+    else {
+      run++;
+    }
+  }
+  if (run < npages || !kseg2_mappages(start, npages, true)) {
+    spinlock_release(&kseg2_lock);
+    return 0;
+  }
+  spinlock_release(&kseg2_lock);
+
+  return MIPS_KSEG2 + start * PAGE_SIZE;
+#else
+  (void)npages;
+  return 0;
+#endif
+}
+
+#if OPT_A3
+static
+void
+free_kvpages(vaddr_t addr)
+{
+  unsigned i;
+  paddr_t pa;
+
+  KASSERT(addr % PAGE_SIZE == 0);
+  i = (addr - MIPS_KSEG2) / PAGE_SIZE;
+  KASSERT(i < KSEG2_NPAGES);
+
+  spinlock_acquire(&kseg2_lock);
+  KASSERT(kseg2_map[i] & KSEG2_FIRST);
+  do {
+    pa = kseg2_map[i] & PAGE_FRAME;
+    kseg2_map[i] = 0;
+    kseg2_tlbinvalidate(MIPS_KSEG2 + i * PAGE_SIZE);
+    free_kpages(PADDR_TO_KVADDR(pa));
+    i++;
+  } while (i < KSEG2_NPAGES &&
+           (kseg2_map[i] & (KSEG2_INUSE | KSEG2_FIRST)) == KSEG2_INUSE);
+  spinlock_release(&kseg2_lock);
+}
+#endif
+
+/*
+ * Extend an allocation of OLDNPAGES at ADDR to NEWNPAGES without
+ * moving it, if the pages after it are free. Works for both the
+ * directly mapped pages from alloc_kpages and the ones from
+ * alloc_kvpages.
+ */
+bool
+grow_kpages(vaddr_t addr, unsigned oldnpages, unsigned newnpages)
+{
+#if OPT_A3
+  unsigned start, i;
+  int *map;
+  bool ok;
+
+  KASSERT(oldnpages > 0 && newnpages > oldnpages);
+
+  if (addr >= MIPS_KSEG2) {
+    start = (addr - MIPS_KSEG2) / PAGE_SIZE;
+    if (start + newnpages > KSEG2_NPAGES) {
+      return false;
+    }
+    spinlock_acquire(&kseg2_lock);
+    KASSERT(kseg2_map[start] & KSEG2_FIRST);
+    ok = true;
+    for (i = start + oldnpages; i < start + newnpages; i++) {
+      if (kseg2_map[i] != 0) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok) {
+      ok = kseg2_mappages(start + oldnpages, newnpages - oldnpages, false);
+    }
+    spinlock_release(&kseg2_lock);
+    return ok;
+  }
+
+  if (!coremap_ready) {
+    return false;
+  }
+  map = (int *) PADDR_TO_KVADDR(coremap_start);
+  start = (KVADDR_TO_PADDR(addr) - coremap_base) / PAGE_SIZE;
+  if (start + newnpages > coremap_size) {
+    return false;
+  }
+
+  spinlock_acquire(&coremap_lock);
+  KASSERT(map[start] == 1);
+  for (i = start + oldnpages; i < start + newnpages; i++) {
+    if (map[i] != 0) {
+      spinlock_release(&coremap_lock);
+      return false;
+    }
+  }
+  /* coremap runs are numbered 1..n; continue the numbering */
+  for (i = start + oldnpages; i < start + newnpages; i++) {
+    map[i] = (int) (i - start + 1);
+  }
+  spinlock_release(&coremap_lock);
+  return true;
+#else
+  (void)addr;
+  (void)oldnpages;
+  (void)newnpages;
+  return false;
+#endif
+}
+
+#if OPT_A3
+/*
+ * Load the TLB for a kernel fault in the kseg2 window.
+ */
+static
+int
+kseg2_fault(int faulttype, vaddr_t faultaddress)
+{
+  unsigned i;
+  uint32_t ehi, elo, ent;
+  int spl, slot;
+
+  i = (faultaddress - MIPS_KSEG2) / PAGE_SIZE;
+  if (faulttype == VM_FAULT_READONLY || i >= KSEG2_NPAGES) {
+    return EFAULT;
+  }
+  ent = kseg2_map[i];
+  if ((ent & KSEG2_INUSE) == 0) {
+    return EFAULT;
+  }
+
+  ehi = faultaddress;
+  elo = (ent & PAGE_FRAME) | TLBLO_DIRTY | TLBLO_VALID;
+
+  spl = splhigh();
+  slot = tlb_probe(ehi, 0);
+  if (slot >= 0) {
+    tlb_write(ehi, elo, slot);
+  }
+  else {
+    tlb_random(ehi, elo);
+  }
+  splx(spl);
+  return 0;
+}
+#endif
+
+/*
+ * Handle a fault in an mmap()ed region. A write to a page that was
+ * entered read-only replaces its TLB entry.
+ */
+static
+int
+dumbvm_mmapfault(struct addrspace *as, int faulttype, vaddr_t faultaddress)
+{
+	paddr_t paddr;
+	bool writable;
+	uint32_t ehi, elo;
+	int i, spl, result;
+
+	result = mmap_fault(as, faulttype, faultaddress, &paddr, &writable);
+	if (result) {
+		return result;
+	}
+
+	ehi = faultaddress;
+	elo = paddr | TLBLO_VALID;
+	if (writable) {
+		elo |= TLBLO_DIRTY;
+	}
+
+	spl = splhigh();
+	i = tlb_probe(ehi, 0);
+	if (i >= 0) {
+		tlb_write(ehi, elo, i);
+	}
+	else {
+		tlb_random(ehi, elo);
+	}
+	splx(spl);
+	return 0;
+}
+
 void
 vm_tlbshootdown_all(void)
 {
@@ -216,8 +556,11 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	switch (faulttype) {
     case VM_FAULT_READONLY:
 #if OPT_A3
-      return EFAULT;
-		/* We always create pages read-write, so we can't get this */
+      /*
+       * Only the code segment and mmap()ed pages are entered
+       * read-only; sort out which below.
+       */
+      break;
 #else
       panic("dumbvm: got VM_FAULT_READONLY\n");
 #endif
@@ -228,6 +571,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
       return EINVAL;
 	}
 
+#if OPT_A3
+  /* Kernel pages mapped by alloc_kvpages; no process involved */
+  if (faultaddress >= MIPS_KSEG2) {
+    return kseg2_fault(faulttype, faultaddress);
+  }
+#endif
+
 	if (curproc == NULL) {
 		/*
 		 * No process. This is probably a kernel fault early
@@ -237,6 +587,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;
 	}
 
+	RU_CHARGE(ru_tlbfaults, 1);
+
 	as = curproc_getas();
 	if (as == NULL) {
 		/*
@@ -271,6 +623,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
   bool code_seg = false;
   bool loadelf_complete = as->loadelf_complete;
 
+  if (faulttype == VM_FAULT_READONLY) {
+    return dumbvm_mmapfault(as, faulttype, faultaddress);
+  }
+
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1[0];
     code_seg = true;
@@ -282,7 +638,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		paddr = (faultaddress - stackbase) + as->as_stackpbase[0];
 	}
 	else {
-		return EFAULT;
+		return dumbvm_mmapfault(as, faulttype, faultaddress);
 	}
 #else
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
@@ -360,6 +716,9 @@ as_create(void)
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
 #endif
+	as->as_mmaps = NULL;
+	/* Leave an unmapped guard page under the stack */
+	as->as_mmaptop = USERSTACK - (DUMBVM_STACKPAGES + 1) * PAGE_SIZE;
 
 	return as;
 }
@@ -381,6 +740,7 @@ as_destroy(struct addrspace *as)
   /* free_kpages(PADDR_TO_KVADDR(as->as_pbase2)); */
   /* free_kpages(PADDR_TO_KVADDR(as->as_stackpbase)); */
 #endif
+	mmap_destroyall(as);
 	kfree(as);
 }
 
@@ -595,6 +955,11 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
 #endif
+	if (mmap_copy(old, new)) {
+		as_destroy(new);
+		return ENOMEM;
+	}
+
 	*ret = new;
 	return 0;
 }
@@ -35,7 +35,8 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
-#include <synch.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <platform/bus.h>
 #include <vfs.h>
 #include <lamebus/lhd.h>
@@ -95,15 +96,123 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Choose the next request to run, elevator style (C-LOOK): the
+ * lowest-numbered request at or past where the head is now, or if
+ * there are none, the lowest-numbered request overall. The queue is
+ * kept sorted by sector, so this is a single walk down it. Returns
+ * NULL if the queue is empty. Call with lh_lock held.
+ */
+static
+struct devreq *
+lhd_pick(struct lhd_softc *lh)
+{
+	struct devreq **pp, **best;
+	struct devreq *req;
+
+	best = NULL;
+	for (pp = &lh->lh_queue; *pp != NULL; pp = &(*pp)->dr_next) {
+		if ((*pp)->dr_block >= lh->lh_headpos) {
+			best = pp;
+			break;
+		}
+	}
+	if (best == NULL) {
+		/* Nothing further out; sweep back to the start. */
+		best = &lh->lh_queue;
+	}
+
+	req = *best;
+	if (req != NULL) {
+		*best = req->dr_next;
+		req->dr_next = NULL;
+	}
+	return req;
+}
+
+/*
+ * Get the hardware going on the next sector, if there's anything to
+ * do. Call with lh_lock held and the device idle.
+ */
+static
+void
+lhd_start(struct lhd_softc *lh)
+{
+	struct devreq *req;
+	uint32_t sector;
+	uint32_t statval = LHD_WORKING;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (lh->lh_cur == NULL) {
+		lh->lh_cur = lhd_pick(lh);
+		if (lh->lh_cur == NULL) {
+			/* Nothing to do */
+			return;
+		}
+		devstats_started(&lh->lh_dev, lh->lh_cur);
+	}
+	req = lh->lh_cur;
+	sector = req->dr_block + req->dr_xfered;
+
+	/* Are we writing? If so, transfer the data to the on-card buffer. */
+	if (req->dr_write) {
+		memcpy(lh->lh_buf,
+		       (char *)req->dr_buf + req->dr_xfered * LHD_SECTSIZE,
+		       LHD_SECTSIZE);
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, sector);
+
+	/* and start the operation. */
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+
+	lh->lh_headpos = sector;
+}
+
+/*
+ * Record that a sector has completed: copy the data out if reading,
+ * move on to the next sector or request, and if the current request
+ * is finished, report it. The callback is made without the lock held.
  */
 static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct devreq *req, *done = NULL;
+
+	spinlock_acquire(&lh->lh_lock);
+
+	req = lh->lh_cur;
+	KASSERT(req != NULL);
+
+	/*
+	 * Are we reading? If so, and if we succeeded, transfer the
+	 * data out of the on-card buffer.
+	 */
+	if (err == 0 && !req->dr_write) {
+		memcpy((char *)req->dr_buf + req->dr_xfered * LHD_SECTSIZE,
+		       lh->lh_buf, LHD_SECTSIZE);
+	}
+	if (err == 0) {
+		req->dr_xfered++;
+	}
+
+	if (err != 0 || req->dr_xfered == req->dr_nblocks) {
+		req->dr_result = err;
+		lh->lh_cur = NULL;
+		done = req;
+	}
+
+	lhd_start(lh);
+
+	spinlock_release(&lh->lh_lock);
+
+	if (done != NULL) {
+		devstats_done(&lh->lh_dev, done);
+		done->dr_done(done);
+	}
 }
 
 /*
@@ -132,6 +241,46 @@ lhd_irq(void *vlh)
 	}
 }
 
+/*
+ * Queue an asynchronous request. Requests are kept sorted by sector
+ * (equal ones in arrival order) for the benefit of lhd_pick.
+ */
+static
+int
+lhd_submit(struct device *d, struct devreq *req)
+{
+	struct lhd_softc *lh = d->d_data;
+	struct devreq **pp;
+
+	/* Don't allow empty I/O or I/O past the end of the disk. */
+	if (req->dr_nblocks == 0 ||
+	    req->dr_block + req->dr_nblocks > lh->lh_dev.d_blocks ||
+	    req->dr_block + req->dr_nblocks < req->dr_block) {
+		return EINVAL;
+	}
+
+	req->dr_result = 0;
+	req->dr_xfered = 0;
+	devstats_queued(&lh->lh_dev, req);
+
+	spinlock_acquire(&lh->lh_lock);
+
+	pp = &lh->lh_queue;
+	while (*pp != NULL && (*pp)->dr_block <= req->dr_block) {
+		pp = &(*pp)->dr_next;
+	}
+	req->dr_next = *pp;
+	*pp = req;
+
+	if (lh->lh_cur == NULL) {
+		/* Device is idle; kick it. */
+		lhd_start(lh);
+	}
+
+	spinlock_release(&lh->lh_lock);
+	return 0;
+}
+
 /*
  * Function called when we are open()'d.
  */
@@ -193,8 +342,56 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Completion callback for lhd_io: flag the request done and wake up
+ * whoever is waiting. lhd_io sleeps with the wchan locked while it
+ * checks the flag, so the wakeup can't be lost.
+ */
+static
+void
+lhd_syncdone(struct devreq *req)
+{
+	struct lhd_softc *lh = req->dr_data;
+
+	req->dr_data = NULL;
+	wchan_wakeall(lh->lh_wchan);
+}
+
+/*
+ * Submit a request and wait for it to finish.
+ */
+static
+int
+lhd_syncio(struct lhd_softc *lh, struct devreq *req)
+{
+	int result;
+
+	req->dr_done = lhd_syncdone;
+	req->dr_data = lh;
+
+	wchan_lock(lh->lh_wchan);
+	result = lhd_submit(&lh->lh_dev, req);
+	if (result) {
+		wchan_unlock(lh->lh_wchan);
+		return result;
+	}
+	while (*(void * volatile *)&req->dr_data != NULL) {
+		wchan_sleep(lh->lh_wchan);
+		wchan_lock(lh->lh_wchan);
+	}
+	wchan_unlock(lh->lh_wchan);
+
+	return req->dr_result;
+}
+
 /*
  * I/O function (for both reads and writes)
+ *
+ * This is a synchronous wrapper around lhd_submit. If the uio is a
+ * single kernel buffer the hardware copies straight to or from it;
+ * otherwise we go through a bounce buffer LHD_IOCHUNK sectors at a
+ * time, since user memory can't be touched from the interrupt
+ * handler.
  */
 static
 int
@@ -206,8 +403,9 @@ lhd_io(struct device *d, struct uio *uio)
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
+	struct devreq req;
+	char *bounce;
+	uint32_t n;
 	int result;
 
 	/* Don't allow I/O that isn't sector-aligned. */
@@ -220,59 +418,69 @@ lhd_io(struct device *d, struct uio *uio)
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (len == 0) {
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	req.dr_write = (uio->uio_rw == UIO_WRITE);
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+	if (uio->uio_segflg == UIO_SYSSPACE && uio->uio_iovcnt == 1) {
+		struct iovec *iov = uio->uio_iov;
 
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
-		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			if (result) {
-				V(lh->lh_clear);
-				return result;
-			}
+		KASSERT(iov->iov_len >= len * LHD_SECTSIZE);
+		req.dr_block = sector;
+		req.dr_nblocks = len;
+		req.dr_buf = iov->iov_kbase;
+		result = lhd_syncio(lh, &req);
+		if (result) {
+			return result;
 		}
 
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
+		/* Account for the transfer as uiomove would have. */
+		iov->iov_kbase = (char *)iov->iov_kbase + len * LHD_SECTSIZE;
+		iov->iov_len -= len * LHD_SECTSIZE;
+		uio->uio_offset += len * LHD_SECTSIZE;
+		uio->uio_resid -= len * LHD_SECTSIZE;
+		return 0;
+	}
 
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
+	bounce = kmalloc(LHD_IOCHUNK * LHD_SECTSIZE);
+	if (bounce == NULL) {
+		return ENOMEM;
+	}
 
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
+	result = 0;
+	while (len > 0) {
+		n = len < LHD_IOCHUNK ? len : LHD_IOCHUNK;
 
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+		if (req.dr_write) {
+			result = uiomove(bounce, n * LHD_SECTSIZE, uio);
+			if (result) {
+				break;
+			}
 		}
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
-
-		/* If we failed, return the error. */
+		req.dr_block = sector;
+		req.dr_nblocks = n;
+		req.dr_buf = bounce;
+		result = lhd_syncio(lh, &req);
 		if (result) {
-			return result;
+			break;
 		}
+
+		if (!req.dr_write) {
+			result = uiomove(bounce, n * LHD_SECTSIZE, uio);
+			if (result) {
+				break;
+			}
+		}
+
+		sector += n;
+		len -= n;
 	}
 
-	return 0;
+	kfree(bounce);
+	return result;
 }
 
 /*
@@ -289,15 +497,14 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
-	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_queue = NULL;
+	lh->lh_cur = NULL;
+	lh->lh_headpos = 0;
+	lh->lh_wchan = wchan_create("lhd");
+	if (lh->lh_wchan == NULL) {
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
 
@@ -306,6 +513,7 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	lh->lh_dev.d_close = lhd_close;
 	lh->lh_dev.d_io = lhd_io;
 	lh->lh_dev.d_ioctl = lhd_ioctl;
+	lh->lh_dev.d_submit = lhd_submit;
 	lh->lh_dev.d_blocks = bus_read_register(lh->lh_busdata, lh->lh_buspos,
 						LHD_REG_NSECT);
 	lh->lh_dev.d_blocksize = LHD_SECTSIZE;
@@ -30,6 +30,7 @@
 #ifndef _LAMEBUS_LHD_H_
 #define _LAMEBUS_LHD_H_
 
+#include <spinlock.h>
 #include <device.h>
 
 /*
@@ -37,6 +38,11 @@
  */
 #define LHD_SECTSIZE  512
 
+/*
+ * Largest transfer lhd_io bounces through a kernel buffer at once.
+ */
+#define LHD_IOCHUNK   4
+
 /*
  * Hardware device data associated with lhd (LAMEbus hard disk)
  */
@@ -51,9 +57,11 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	struct spinlock lh_lock;	/* Protects the request queue */
+	struct devreq *lh_queue;	/* Waiting requests, by sector */
+	struct devreq *lh_cur;		/* Request on the hardware, or NULL */
+	uint32_t lh_headpos;		/* Sector last sent to the hardware */
+	struct wchan *lh_wchan;		/* Where lhd_io waits */
 
 	struct device lh_dev;		/* VFS device structure */
 };
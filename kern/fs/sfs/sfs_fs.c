@@ -358,6 +358,18 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	sfs->sfs_superdirty = false;
 	sfs->sfs_freemapdirty = false;
 
+	/* Start the read-ahead thread, if this is the first mount */
+	result = sfs_ra_bootstrap();
+	if (result) {
+		kprintf("sfs: no read-ahead: %s\n", strerror(result));
+	}
+
+	/* Likewise the syncer, which flushes delayed writes */
+	result = sfs_wb_bootstrap();
+	if (result) {
+		kprintf("sfs: no syncer: %s\n", strerror(result));
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
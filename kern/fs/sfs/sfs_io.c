@@ -30,6 +30,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <current.h>
+#include <thread.h>
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
@@ -56,6 +58,13 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
 
+	if (uio->uio_rw == UIO_READ) {
+		RU_CHARGE(ru_inblock, uio->uio_resid / SFS_BLOCKSIZE);
+	}
+	else {
+		RU_CHARGE(ru_oublock, uio->uio_resid / SFS_BLOCKSIZE);
+	}
+
  retry:
 	result = sfs->sfs_device->d_io(sfs->sfs_device, uio);
 	if (result == EINVAL) {
@@ -0,0 +1,495 @@
+/*
+ * SFS filesystem
+ *
+ * Sequential read-ahead.
+ *
+ * When a file is read sequentially we fetch the blocks after the
+ * current read position into a small per-file buffer, so the next
+ * read() finds its data already in memory. The fetching is done by
+ * a kernel thread, so the disk works while the reader is off
+ * computing with what it just got.
+ *
+ * The prefetch thread looks up the disk blocks while holding the vfs
+ * big lock, but does the disk I/O without it. Readers and writers
+ * that run into a fetch in progress wait on the buffer's cv; because
+ * the thread needs nothing but the buffer lock to finish, it is safe
+ * for them to do so while holding the big lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <uio.h>
+#include <synch.h>
+#include <current.h>
+#include <thread.h>
+#include <vfs.h>
+#include <device.h>
+#include <sfs.h>
+
+/* Ring slot of a file block */
+#define RASLOT(ra, fileblock) \
+	((ra)->ra_data + ((fileblock) % SFS_RAMAX) * SFS_BLOCKSIZE)
+
+/* Files waiting for the prefetch thread; each holds a vnode reference */
+static struct vnodearray *sfs_raqueue;
+static struct lock *sfs_raqueue_lock;
+static struct cv *sfs_raqueue_cv;
+
+/* Counts completed device requests for the prefetch thread */
+static struct semaphore *sfs_ra_sem;
+
+/*
+ * Completion callback for prefetch requests. May run in an interrupt
+ * handler.
+ */
+static
+void
+sfs_ra_iodone(struct devreq *req)
+{
+	(void)req;
+	V(sfs_ra_sem);
+}
+
+/*
+ * Read N file blocks, starting at FIRST, into their ring slots.
+ * Devices with a request queue get all the runs of contiguous disk
+ * blocks at once, so they can schedule them together; otherwise we
+ * read one block at a time. Returns how many blocks were read
+ * successfully, counting from the first.
+ */
+static
+uint32_t
+sfs_ra_readblocks(struct sfs_fs *sfs, struct sfs_rabuf *ra, uint32_t first,
+		  const uint32_t *diskblocks, uint32_t n)
+{
+	struct device *dev = sfs->sfs_device;
+	struct devreq reqs[SFS_RAMAX];
+	uint32_t i, nreqs, nsent;
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	if (dev->d_submit == NULL) {
+		for (i=0; i<n; i++) {
+			if (diskblocks[i] == 0) {
+				/* Hole in the file */
+				bzero(RASLOT(ra, first+i), SFS_BLOCKSIZE);
+				continue;
+			}
+			SFSUIO(&iov, &ku, RASLOT(ra, first+i),
+			       diskblocks[i], UIO_READ);
+			result = dev->d_io(dev, &ku);
+			if (result) {
+				return i;
+			}
+			RU_CHARGE(ru_inblock, 1);
+		}
+		return n;
+	}
+
+	nreqs = 0;
+	for (i=0; i<n; i++) {
+		struct devreq *prev = nreqs > 0 ? &reqs[nreqs-1] : NULL;
+		char *slot = RASLOT(ra, first+i);
+
+		if (diskblocks[i] == 0) {
+			bzero(slot, SFS_BLOCKSIZE);
+			continue;
+		}
+
+		/* Extend the last request if both disk and ring line up */
+		if (prev != NULL && diskblocks[i-1] != 0 &&
+		    diskblocks[i] == prev->dr_block + prev->dr_nblocks &&
+		    slot == (char *)prev->dr_buf +
+			    prev->dr_nblocks * SFS_BLOCKSIZE) {
+			prev->dr_nblocks++;
+			continue;
+		}
+
+		reqs[nreqs].dr_block = diskblocks[i];
+		reqs[nreqs].dr_nblocks = 1;
+		reqs[nreqs].dr_buf = slot;
+		reqs[nreqs].dr_write = false;
+		reqs[nreqs].dr_done = sfs_ra_iodone;
+		reqs[nreqs].dr_data = (void *)i;
+		nreqs++;
+	}
+
+	/* Fire them all off, then wait for however many got started */
+	for (nsent=0; nsent<nreqs; nsent++) {
+		result = dev->d_submit(dev, &reqs[nsent]);
+		if (result) {
+			break;
+		}
+		RU_CHARGE(ru_inblock, reqs[nsent].dr_nblocks);
+	}
+	for (i=0; i<nsent; i++) {
+		P(sfs_ra_sem);
+	}
+
+	/* The good blocks end at the first request that failed or wasn't sent */
+	for (i=0; i<nreqs; i++) {
+		if (i >= nsent || reqs[i].dr_result != 0) {
+			return (uint32_t)reqs[i].dr_data;
+		}
+	}
+	return n;
+}
+
+/*
+ * Fetch the blocks of SV that were queued for read-ahead.
+ */
+static
+void
+sfs_ra_fetch(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_rabuf *ra = sv->sv_ra;
+	uint32_t diskblocks[SFS_RAMAX];
+	uint32_t first, n, i;
+	int result;
+
+	vfs_biglock_acquire();
+
+	lock_acquire(ra->ra_lock);
+	if (ra->ra_pend == ra->ra_end) {
+		/* Cancelled (or invalidated) before we got to it */
+		lock_release(ra->ra_lock);
+		vfs_biglock_release();
+		return;
+	}
+	first = ra->ra_end;
+	n = ra->ra_pend - ra->ra_end;
+	KASSERT(n <= SFS_RAMAX);
+	ra->ra_inflight = true;
+	lock_release(ra->ra_lock);
+
+	for (i=0; i<n; i++) {
+		result = sfs_bmap(sv, first+i, 0, &diskblocks[i]);
+		if (result) {
+			n = i;
+			break;
+		}
+	}
+
+	vfs_biglock_release();
+
+	/* On error, let the reader hit (and report) it itself */
+	n = sfs_ra_readblocks(sfs, ra, first, diskblocks, n);
+
+	lock_acquire(ra->ra_lock);
+	ra->ra_end = first + n;
+	ra->ra_pend = ra->ra_end;
+	ra->ra_inflight = false;
+	cv_broadcast(ra->ra_cv, ra->ra_lock);
+	lock_release(ra->ra_lock);
+}
+
+/*
+ * The prefetch thread.
+ */
+static
+void
+sfs_ra_thread(void *unused1, unsigned long unused2)
+{
+	struct vnode *v;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		lock_acquire(sfs_raqueue_lock);
+		while (vnodearray_num(sfs_raqueue) == 0) {
+			cv_wait(sfs_raqueue_cv, sfs_raqueue_lock);
+		}
+		v = vnodearray_get(sfs_raqueue, 0);
+		vnodearray_remove(sfs_raqueue, 0);
+		lock_release(sfs_raqueue_lock);
+
+		sfs_ra_fetch(v->vn_data);
+		VOP_DECREF(v);
+	}
+}
+
+/*
+ * Start the prefetch thread. Called on every mount; only the first
+ * call does anything.
+ */
+int
+sfs_ra_bootstrap(void)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_raqueue != NULL) {
+		return 0;
+	}
+
+	sfs_raqueue_lock = lock_create("sfs_raqueue");
+	if (sfs_raqueue_lock == NULL) {
+		return ENOMEM;
+	}
+	sfs_raqueue_cv = cv_create("sfs_raqueue");
+	if (sfs_raqueue_cv == NULL) {
+		lock_destroy(sfs_raqueue_lock);
+		return ENOMEM;
+	}
+	sfs_ra_sem = sem_create("sfs_ra", 0);
+	if (sfs_ra_sem == NULL) {
+		cv_destroy(sfs_raqueue_cv);
+		lock_destroy(sfs_raqueue_lock);
+		return ENOMEM;
+	}
+	sfs_raqueue = vnodearray_create();
+	if (sfs_raqueue == NULL) {
+		sem_destroy(sfs_ra_sem);
+		cv_destroy(sfs_raqueue_cv);
+		lock_destroy(sfs_raqueue_lock);
+		return ENOMEM;
+	}
+
+	result = thread_fork("sfs_readahead", NULL, sfs_ra_thread, NULL, 0);
+	if (result) {
+		vnodearray_destroy(sfs_raqueue);
+		sfs_raqueue = NULL;
+		sem_destroy(sfs_ra_sem);
+		cv_destroy(sfs_raqueue_cv);
+		lock_destroy(sfs_raqueue_lock);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Allocate the read-ahead buffer for a file.
+ */
+static
+struct sfs_rabuf *
+sfs_ra_create(void)
+{
+	struct sfs_rabuf *ra;
+
+	ra = kmalloc(sizeof(*ra));
+	if (ra == NULL) {
+		return NULL;
+	}
+	ra->ra_data = kmalloc(SFS_RAMAX * SFS_BLOCKSIZE);
+	if (ra->ra_data == NULL) {
+		kfree(ra);
+		return NULL;
+	}
+	ra->ra_lock = lock_create("sfs_ra");
+	if (ra->ra_lock == NULL) {
+		kfree(ra->ra_data);
+		kfree(ra);
+		return NULL;
+	}
+	ra->ra_cv = cv_create("sfs_ra");
+	if (ra->ra_cv == NULL) {
+		lock_destroy(ra->ra_lock);
+		kfree(ra->ra_data);
+		kfree(ra);
+		return NULL;
+	}
+	ra->ra_start = ra->ra_end = ra->ra_pend = 0;
+	ra->ra_inflight = false;
+	return ra;
+}
+
+/*
+ * Try to satisfy part of a read from the read-ahead buffer: LEN
+ * bytes of file block FILEBLOCK, starting SKIP bytes in. Returns
+ * true, with the uiomove result in *RESULT, if the block was there.
+ */
+bool
+sfs_ra_read(struct sfs_vnode *sv, uint32_t fileblock,
+	    uint32_t skip, uint32_t len, struct uio *uio, int *result)
+{
+	struct sfs_rabuf *ra = sv->sv_ra;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(skip + len <= SFS_BLOCKSIZE);
+
+	if (ra == NULL) {
+		return false;
+	}
+
+	lock_acquire(ra->ra_lock);
+
+	/* If it's on its way, wait for it. */
+	while (ra->ra_inflight &&
+	       fileblock >= ra->ra_end && fileblock < ra->ra_pend) {
+		cv_wait(ra->ra_cv, ra->ra_lock);
+	}
+
+	if (fileblock >= ra->ra_start && fileblock < ra->ra_end) {
+		*result = uiomove(RASLOT(ra, fileblock) + skip, len, uio);
+		lock_release(ra->ra_lock);
+		return true;
+	}
+
+	if (!ra->ra_inflight &&
+	    fileblock >= ra->ra_end && fileblock < ra->ra_pend) {
+		/*
+		 * Queued, but the prefetch thread hasn't started on
+		 * it. We'd only wait for it to do what we're about to
+		 * do ourselves, so cancel it.
+		 */
+		ra->ra_pend = ra->ra_end;
+	}
+
+	lock_release(ra->ra_lock);
+	return false;
+}
+
+/*
+ * Called after each read() of a file, with the offsets it covered.
+ * Works out whether the file is being read sequentially, adjusts the
+ * read-ahead window, and queues the next window for prefetching if
+ * the buffer is running low.
+ */
+void
+sfs_ra_update(struct sfs_vnode *sv, off_t pos, off_t endpos)
+{
+	struct sfs_rabuf *ra;
+	uint32_t first, last, want, eofblock;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (endpos <= pos || sfs_raqueue == NULL) {
+		return;
+	}
+
+	first = pos / SFS_BLOCKSIZE;
+	last = (endpos - 1) / SFS_BLOCKSIZE;
+
+	/* Sequential if we start where the last read left off */
+	if (first == sv->sv_ranext || first + 1 == sv->sv_ranext) {
+		if (sv->sv_rawindow == 0) {
+			sv->sv_rawindow = SFS_RAMIN;
+		}
+		else if (sv->sv_rawindow < SFS_RAMAX) {
+			sv->sv_rawindow *= 2;
+		}
+	}
+	else {
+		sv->sv_rawindow = 0;
+	}
+	sv->sv_ranext = last + 1;
+
+	if (sv->sv_rawindow == 0) {
+		return;
+	}
+
+	if (sv->sv_ra == NULL) {
+		sv->sv_ra = sfs_ra_create();
+		if (sv->sv_ra == NULL) {
+			/* No memory; just don't read ahead */
+			return;
+		}
+	}
+	ra = sv->sv_ra;
+
+	lock_acquire(ra->ra_lock);
+
+	if (ra->ra_inflight || ra->ra_pend != ra->ra_end) {
+		/* Already fetching */
+		lock_release(ra->ra_lock);
+		return;
+	}
+
+	/*
+	 * Drop what the reader has moved past, keeping the last block
+	 * read in case the next read picks up partway through it.
+	 */
+	if (ra->ra_start > last || ra->ra_end <= last) {
+		ra->ra_start = ra->ra_end = ra->ra_pend = last + 1;
+	}
+	else {
+		ra->ra_start = last;
+	}
+
+	/* Don't bother if we still have half a window in hand. */
+	if (ra->ra_end > last + 1 + sv->sv_rawindow / 2) {
+		lock_release(ra->ra_lock);
+		return;
+	}
+
+	eofblock = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	want = last + 1 + sv->sv_rawindow;
+	if (want > eofblock) {
+		want = eofblock;
+	}
+	if (want > ra->ra_start + SFS_RAMAX) {
+		want = ra->ra_start + SFS_RAMAX;
+	}
+	if (want <= ra->ra_end) {
+		lock_release(ra->ra_lock);
+		return;
+	}
+	ra->ra_pend = want;
+	lock_release(ra->ra_lock);
+
+	/* Hand it to the prefetch thread */
+	VOP_INCREF(&sv->sv_v);
+	lock_acquire(sfs_raqueue_lock);
+	if (vnodearray_add(sfs_raqueue, &sv->sv_v, NULL)) {
+		lock_release(sfs_raqueue_lock);
+		lock_acquire(ra->ra_lock);
+		ra->ra_pend = ra->ra_end;
+		lock_release(ra->ra_lock);
+		VOP_DECREF(&sv->sv_v);
+		return;
+	}
+	cv_signal(sfs_raqueue_cv, sfs_raqueue_lock);
+	lock_release(sfs_raqueue_lock);
+}
+
+/*
+ * Throw away any read-ahead data for a file, because it is being
+ * written or truncated. Waits for a fetch in progress to finish.
+ */
+void
+sfs_ra_invalidate(struct sfs_vnode *sv)
+{
+	struct sfs_rabuf *ra = sv->sv_ra;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	sv->sv_rawindow = 0;
+	if (ra == NULL) {
+		return;
+	}
+
+	lock_acquire(ra->ra_lock);
+	while (ra->ra_inflight) {
+		cv_wait(ra->ra_cv, ra->ra_lock);
+	}
+	ra->ra_start = ra->ra_end = ra->ra_pend = 0;
+	lock_release(ra->ra_lock);
+}
+
+/*
+ * Free a file's read-ahead buffer, on reclaim. The prefetch thread
+ * holds a reference while it works on a file, so it can't be busy
+ * with this one.
+ */
+void
+sfs_ra_destroy(struct sfs_vnode *sv)
+{
+	struct sfs_rabuf *ra = sv->sv_ra;
+
+	if (ra == NULL) {
+		return;
+	}
+	KASSERT(!ra->ra_inflight);
+
+	cv_destroy(ra->ra_cv);
+	lock_destroy(ra->ra_lock);
+	kfree(ra->ra_data);
+	kfree(ra);
+	sv->sv_ra = NULL;
+}
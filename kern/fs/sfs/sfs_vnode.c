@@ -84,15 +84,19 @@ sfs_sync_inode(struct sfs_vnode *sv)
 // Space allocation
 
 /*
- * Allocate a block.
+ * Allocate a block. We take the first free block at or after GOAL
+ * (wrapping around), so callers that know where related blocks live
+ * can keep them together on disk. The block is zeroed on disk unless
+ * CLEAR is false, for callers about to write the whole thing anyway.
  */
 static
 int
-sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, uint32_t goal, bool clear,
+	   uint32_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
 		return result;
 	}
@@ -103,7 +107,7 @@ sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
 	}
 
 	/* Clear block before returning it */
-	return sfs_clearblock(sfs, *diskblock);
+	return clear ? sfs_clearblock(sfs, *diskblock) : 0;
 }
 
 /*
@@ -131,6 +135,80 @@ sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 	return bitmap_isset(sfs->sfs_freemap, diskblock);
 }
 
+/*
+ * Give back any blocks reserved past the end of a file.
+ */
+static
+void
+sfs_prealloc_release(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+
+	while (sv->sv_npreallocs > 0) {
+		sfs_bfree(sfs, sv->sv_prealloc);
+		sv->sv_prealloc++;
+		sv->sv_npreallocs--;
+	}
+}
+
+/*
+ * Allocate a data (or indirect) block for a file.
+ *
+ * GOAL is the block right after the one preceding the new block in
+ * the file, or 0 if the preceding block isn't mapped. If GOAL is the
+ * next block of the file's reservation, the write is sequential and
+ * we hand that block out. Otherwise we look for a free block at GOAL
+ * and reserve the free blocks that follow it, so the next sequential
+ * write lands right behind this one even if some other file is being
+ * written at the same time. Blocks with no predecessor go near the
+ * inode. CLEAR is as for sfs_balloc.
+ */
+static
+int
+sfs_balloc_file(struct sfs_vnode *sv, uint32_t goal, bool clear,
+		uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t block;
+	int result;
+
+	if (sv->sv_npreallocs > 0) {
+		if (goal == sv->sv_prealloc) {
+			*diskblock = sv->sv_prealloc;
+			sv->sv_prealloc++;
+			sv->sv_npreallocs--;
+
+			/* Clear block before returning it */
+			return clear ? sfs_clearblock(sfs, *diskblock) : 0;
+		}
+
+		/* Not sequential; don't sit on space we won't use. */
+		sfs_prealloc_release(sv);
+	}
+
+	if (goal == 0) {
+		return sfs_balloc(sfs, sv->sv_ino + 1, clear, diskblock);
+	}
+
+	result = sfs_balloc(sfs, goal, clear, diskblock);
+	if (result) {
+		return result;
+	}
+
+	/* Reserve free blocks following it, up to the first one in use. */
+	block = *diskblock + 1;
+	while (sv->sv_npreallocs < SFS_PREALLOC &&
+	       block < sfs->sfs_super.sp_nblocks &&
+	       !sfs_bused(sfs, block)) {
+		bitmap_mark(sfs->sfs_freemap, block);
+		sv->sv_npreallocs++;
+		block++;
+	}
+	sv->sv_prealloc = *diskblock + 1;
+
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Block mapping/inode maintenance
@@ -139,9 +217,9 @@ sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * allocated: zeroed, unless DOALLOC is SFS_BMAP_NOCLEAR. (Indirect
+ * blocks are always zeroed.)
  */
-static
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	 uint32_t *diskblock)
@@ -176,7 +254,17 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			uint32_t goal = 0;
+
+			/* Try to put it right after the previous block */
+			if (fileblock > 0 &&
+			    sv->sv_i.sfi_direct[fileblock-1] != 0) {
+				goal = sv->sv_i.sfi_direct[fileblock-1] + 1;
+			}
+
+			result = sfs_balloc_file(sv, goal,
+						 doalloc != SFS_BMAP_NOCLEAR,
+						 &block);
 			if (result) {
 				return result;
 			}
@@ -236,7 +324,14 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		 * the indirect block. Thus, we need to allocate an
 		 * indirect block.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		uint32_t goal = sv->sv_i.sfi_direct[SFS_NDIRECT-1];
+
+		/* Place it after the last direct block, if there is one */
+		if (goal != 0) {
+			goal++;
+		}
+
+		result = sfs_balloc_file(sv, goal, true, &idblock);
 		if (result) {
 			return result;
 		}
@@ -265,7 +360,19 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		/*
+		 * Aim for the block after the previous one; the first
+		 * block mapped by the indirect block goes right after
+		 * the indirect block itself.
+		 */
+		uint32_t goal = (idoff > 0) ? idbuf[idoff-1] : idblock;
+
+		if (goal != 0) {
+			goal++;
+		}
+
+		result = sfs_balloc_file(sv, goal,
+					 doalloc != SFS_BMAP_NOCLEAR, &block);
 		if (result) {
 			return result;
 		}
@@ -330,6 +437,21 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
+	/* Regular files write (and read back) through the write buffer */
+	if (sv->sv_i.sfi_type == SFS_TYPE_FILE) {
+		if (uio->uio_rw == UIO_WRITE ?
+		    sfs_wb_write(sv, fileblock, skipstart, len, uio, &result) :
+		    sfs_wb_read(sv, fileblock, skipstart, len, uio, &result)) {
+			return result;
+		}
+	}
+
+	/* If reading, see if read-ahead already got it for us */
+	if (uio->uio_rw == UIO_READ &&
+	    sfs_ra_read(sv, fileblock, skipstart, len, uio, &result)) {
+		return result;
+	}
+
 	/* Get the disk block number */
 	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
@@ -395,6 +517,21 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
+	/* Regular files write (and read back) through the write buffer */
+	if (sv->sv_i.sfi_type == SFS_TYPE_FILE) {
+		if (uio->uio_rw == UIO_WRITE ?
+		    sfs_wb_write(sv, fileblock, 0, SFS_BLOCKSIZE, uio, &result) :
+		    sfs_wb_read(sv, fileblock, 0, SFS_BLOCKSIZE, uio, &result)) {
+			return result;
+		}
+	}
+
+	/* If reading, see if read-ahead already got it for us */
+	if (uio->uio_rw == UIO_READ &&
+	    sfs_ra_read(sv, fileblock, 0, SFS_BLOCKSIZE, uio, &result)) {
+		return result;
+	}
+
 	/* Look up the disk block number */
 	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
@@ -787,21 +924,25 @@ sfs_lookonce(struct sfs_vnode *sv, const char *name,
 // Object creation
 
 /*
- * Create a new filesystem object and hand back its vnode.
+ * Create a new filesystem object in directory DIRINO and hand back
+ * its vnode.
  */
 static
 int
-sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
+sfs_makeobj(struct sfs_fs *sfs, uint32_t dirino, int type,
+	    struct sfs_vnode **ret)
 {
 	uint32_t ino;
 	int result;
 
 	/*
 	 * First, get an inode. (Each inode is a block, and the inode 
-	 * number is the block number, so just get a block.)
+	 * number is the block number, so just get a block.) Look for
+	 * one near the directory, so that the inodes of files in the
+	 * same directory end up grouped together.
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, dirino, true, &ino);
 	if (result) {
 		return result;
 	}
@@ -910,6 +1051,22 @@ sfs_reclaim(struct vnode *v)
 		return EBUSY;
 	}
 
+	/*
+	 * Write out any delayed writes, unless the file is about to be
+	 * erased. This can allocate blocks, so do it before giving back
+	 * the reservation.
+	 */
+	if (sv->sv_i.sfi_linkcount > 0) {
+		result = sfs_wb_flush(sv);
+		if (result) {
+			vfs_biglock_release();
+			return result;
+		}
+	}
+
+	/* Give back any blocks we were holding for sequential writes */
+	sfs_prealloc_release(sv);
+
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
 		result = VOP_TRUNCATE(&sv->sv_v, 0);
@@ -952,6 +1109,10 @@ sfs_reclaim(struct vnode *v)
 
 	vfs_biglock_release();
 
+	/* Release the read-ahead and write buffers, if any */
+	sfs_ra_destroy(sv);
+	sfs_wb_destroy(sv);
+
 	/* Release the storage for the vnode structure itself. */
 	kfree(sv);
 
@@ -967,12 +1128,17 @@ int
 sfs_read(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	off_t pos = uio->uio_offset;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
 	vfs_biglock_acquire();
 	result = sfs_io(sv, uio);
+	if (result == 0) {
+		/* Line up the next blocks if this looks sequential */
+		sfs_ra_update(sv, pos, uio->uio_offset);
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -991,6 +1157,7 @@ sfs_write(struct vnode *v, struct uio *uio)
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
 	vfs_biglock_acquire();
+	sfs_ra_invalidate(sv);
 	result = sfs_io(sv, uio);
 	vfs_biglock_release();
 
@@ -1103,6 +1270,20 @@ sfs_fsync(struct vnode *v)
 	int result;
 
 	vfs_biglock_acquire();
+
+	/* Allocate and write out any delayed writes */
+	result = sfs_wb_flush(sv);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/*
+	 * Reserved blocks are marked in the freemap but not recorded
+	 * in the inode; drop them so a synced volume never leaks them.
+	 */
+	sfs_prealloc_release(sv);
+
 	result = sfs_sync_inode(sv);
 	vfs_biglock_release();
 
@@ -1110,14 +1291,16 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Regular files can be mapped any way; directories
+ * use sfs_isdir instead.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, int prot)
 {
 	(void)v;
-	return EUNIMP;
+	(void)prot;
+	return 0;
 }
 
 /*
@@ -1151,6 +1334,12 @@ sfs_truncate(struct vnode *v, off_t len)
 
 	vfs_biglock_acquire();
 
+	/* Buffered read-ahead data may be about to go stale */
+	sfs_ra_invalidate(sv);
+
+	/* Delayed writes past the new end just go away */
+	sfs_wb_truncate(sv, blocklen);
+
 	/*
 	 * Go through the direct blocks. Discard any that are
 	 * past the limit we're truncating to.
@@ -1287,7 +1476,7 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	}
 
 	/* Didn't exist - create it */
-	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
+	result = sfs_makeobj(sfs, sv->sv_ino, SFS_TYPE_FILE, &newguy);
 	if (result) {
 		vfs_biglock_release();
 		return result;
@@ -1706,6 +1895,16 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* No blocks reserved yet */
+	sv->sv_prealloc = 0;
+	sv->sv_npreallocs = 0;
+
+	/* No read-ahead until we see a sequential read */
+	sv->sv_ranext = 0;
+	sv->sv_rawindow = 0;
+	sv->sv_ra = NULL;
+	sv->sv_wb = NULL;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
@@ -0,0 +1,286 @@
+/*
+ * SFS filesystem
+ *
+ * Delayed allocation and write-behind.
+ *
+ * Writes to regular files go into a small per-file buffer instead of
+ * straight to disk. The buffer holds one run of consecutive file
+ * blocks; a write that doesn't touch or extend the run flushes it
+ * first. Disk blocks are not allocated until the run is flushed, at
+ * which point they are allocated in file order, so they usually come
+ * out contiguous and can be written with one request per extent.
+ *
+ * Runs are flushed by fsync (and so by close and sync), on reclaim,
+ * and every SFS_SYNCSECS seconds by the syncer thread.
+ *
+ * Everything here runs under the vfs big lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <clock.h>
+#include <thread.h>
+#include <vfs.h>
+#include <sfs.h>
+
+/* Buffer slot of a file block */
+#define WBSLOT(wb, fileblock) \
+	((wb)->wb_data + ((fileblock) % SFS_WBMAX) * SFS_BLOCKSIZE)
+
+static bool sfs_syncer_started;
+
+/*
+ * The syncer thread: write back dirty data and metadata every so
+ * often, so that it doesn't sit in memory indefinitely.
+ */
+static
+void
+sfs_syncer(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		clocksleep(SFS_SYNCSECS);
+		vfs_sync();
+	}
+}
+
+/*
+ * Start the syncer thread. Called on every mount; only the first
+ * call does anything.
+ */
+int
+sfs_wb_bootstrap(void)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_syncer_started) {
+		return 0;
+	}
+
+	result = thread_fork("sfs_syncer", NULL, sfs_syncer, NULL, 0);
+	if (result) {
+		return result;
+	}
+	sfs_syncer_started = true;
+	return 0;
+}
+
+/*
+ * Allocate the write buffer for a file.
+ */
+static
+struct sfs_wbuf *
+sfs_wb_create(void)
+{
+	struct sfs_wbuf *wb;
+
+	wb = kmalloc(sizeof(*wb));
+	if (wb == NULL) {
+		return NULL;
+	}
+	wb->wb_data = kmalloc(SFS_WBMAX * SFS_BLOCKSIZE);
+	if (wb->wb_data == NULL) {
+		kfree(wb);
+		return NULL;
+	}
+	wb->wb_start = wb->wb_end = 0;
+	return wb;
+}
+
+/*
+ * Write out the buffered run, allocating disk blocks for it. Blocks
+ * that are consecutive on disk (and in the buffer) go out as one
+ * transfer. On error, whatever couldn't be written stays buffered.
+ */
+int
+sfs_wb_flush(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_wbuf *wb = sv->sv_wb;
+	uint32_t diskblocks[SFS_WBMAX];
+	uint32_t fb, n, i, run;
+	struct iovec iov;
+	struct uio ku;
+	int result, mapresult;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (wb == NULL || wb->wb_start == wb->wb_end) {
+		return 0;
+	}
+
+	/*
+	 * Allocate, in file order, so the blocks come out together.
+	 * Every buffered block is complete (sfs_wb_write fills in the
+	 * parts it isn't given), so new blocks needn't be zeroed first.
+	 */
+	n = wb->wb_end - wb->wb_start;
+	mapresult = 0;
+	for (i=0; i<n; i++) {
+		mapresult = sfs_bmap(sv, wb->wb_start + i, SFS_BMAP_NOCLEAR,
+				     &diskblocks[i]);
+		if (mapresult) {
+			/* Write what we could map, then report it */
+			n = i;
+			break;
+		}
+	}
+
+	/* Old copies of these blocks may be in the read-ahead buffer */
+	sfs_ra_invalidate(sv);
+
+	for (i=0; i<n; i += run) {
+		fb = wb->wb_start + i;
+		for (run = 1; i + run < n; run++) {
+			if (diskblocks[i+run] != diskblocks[i] + run ||
+			    (fb + run) % SFS_WBMAX == 0) {
+				break;
+			}
+		}
+		uio_kinit(&iov, &ku, WBSLOT(wb, fb), run * SFS_BLOCKSIZE,
+			  ((off_t)diskblocks[i]) * SFS_BLOCKSIZE, UIO_WRITE);
+		result = sfs_rwblock(sfs, &ku);
+		if (result) {
+			wb->wb_start = fb;
+			return result;
+		}
+	}
+
+	wb->wb_start += n;
+	return mapresult;
+}
+
+/*
+ * Write LEN bytes into file block FILEBLOCK, starting SKIP bytes in,
+ * by way of the write buffer. Returns false if there is no buffer
+ * (we're out of memory) and the caller should write through as
+ * usual; otherwise returns true with the outcome in *RESULT.
+ */
+bool
+sfs_wb_write(struct sfs_vnode *sv, uint32_t fileblock,
+	     uint32_t skip, uint32_t len, struct uio *uio, int *result)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_wbuf *wb;
+	uint32_t diskblock;
+	char *slot;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(skip + len <= SFS_BLOCKSIZE);
+
+	if (sv->sv_wb == NULL) {
+		sv->sv_wb = sfs_wb_create();
+		if (sv->sv_wb == NULL) {
+			return false;
+		}
+	}
+	wb = sv->sv_wb;
+
+	/* Already buffered: just update it */
+	if (fileblock >= wb->wb_start && fileblock < wb->wb_end) {
+		*result = uiomove(WBSLOT(wb, fileblock) + skip, len, uio);
+		return true;
+	}
+
+	/* Unless this extends the run, write the run out and start over */
+	if (wb->wb_start == wb->wb_end || fileblock != wb->wb_end ||
+	    wb->wb_end - wb->wb_start == SFS_WBMAX) {
+		*result = sfs_wb_flush(sv);
+		if (*result) {
+			return true;
+		}
+		wb->wb_start = wb->wb_end = fileblock;
+	}
+
+	/* If we're not covering the whole block, fill in the rest */
+	slot = WBSLOT(wb, fileblock);
+	if (len < SFS_BLOCKSIZE) {
+		*result = sfs_bmap(sv, fileblock, 0, &diskblock);
+		if (*result) {
+			return true;
+		}
+		if (diskblock == 0) {
+			bzero(slot, SFS_BLOCKSIZE);
+		}
+		else {
+			*result = sfs_rblock(sfs, slot, diskblock);
+			if (*result) {
+				return true;
+			}
+		}
+	}
+
+	*result = uiomove(slot + skip, len, uio);
+	if (*result == 0) {
+		wb->wb_end++;
+	}
+	return true;
+}
+
+/*
+ * Try to satisfy part of a read from the write buffer. Same deal as
+ * sfs_ra_read.
+ */
+bool
+sfs_wb_read(struct sfs_vnode *sv, uint32_t fileblock,
+	    uint32_t skip, uint32_t len, struct uio *uio, int *result)
+{
+	struct sfs_wbuf *wb = sv->sv_wb;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(skip + len <= SFS_BLOCKSIZE);
+
+	if (wb == NULL ||
+	    fileblock < wb->wb_start || fileblock >= wb->wb_end) {
+		return false;
+	}
+	*result = uiomove(WBSLOT(wb, fileblock) + skip, len, uio);
+	return true;
+}
+
+/*
+ * Drop buffered blocks at or past file block BLOCKLEN, because the
+ * file is being truncated.
+ */
+void
+sfs_wb_truncate(struct sfs_vnode *sv, uint32_t blocklen)
+{
+	struct sfs_wbuf *wb = sv->sv_wb;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (wb == NULL) {
+		return;
+	}
+	if (blocklen <= wb->wb_start) {
+		wb->wb_end = wb->wb_start;
+	}
+	else if (blocklen < wb->wb_end) {
+		wb->wb_end = blocklen;
+	}
+}
+
+/*
+ * Free a file's write buffer, on reclaim. It must have been flushed
+ * (or truncated away) already.
+ */
+void
+sfs_wb_destroy(struct sfs_vnode *sv)
+{
+	struct sfs_wbuf *wb = sv->sv_wb;
+
+	if (wb == NULL) {
+		return;
+	}
+	KASSERT(wb->wb_start == wb->wb_end);
+
+	kfree(wb->wb_data);
+	kfree(wb);
+	sv->sv_wb = NULL;
+}
@@ -39,6 +39,7 @@
 #include "opt-A3.h"
 
 struct vnode;
+struct mmap_region;
 
 
 /*
@@ -66,6 +67,8 @@ struct addrspace {
   size_t as_npages2;
   paddr_t as_stackpbase;
 #endif
+  struct mmap_region *as_mmaps;  /* mmap()ed regions, by address */
+  vaddr_t as_mmaptop;            /* mmap() places regions below here */
 };
 
 /*
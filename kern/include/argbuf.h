@@ -0,0 +1,30 @@
+#ifndef _ARGBUF_H_
+#define _ARGBUF_H_
+
+/*
+ * Staging buffer for the arguments of a new program.
+ *
+ * The strings are gathered, packed end to end, into one ARG_MAX-sized
+ * kernel buffer, either from user space (execv) or from the kernel
+ * (runprogram). argbuf_copyout then puts the argv pointer array in
+ * front of them, pointing at where the strings will be on the new
+ * user stack, and copies the whole block out in one go.
+ *
+ * The strings plus the argv array, including its terminating NULL,
+ * may take up to ARG_MAX bytes; past that you get E2BIG.
+ */
+
+struct argbuf {
+	char *ab_data;		/* ARG_MAX bytes */
+	size_t ab_len;		/* bytes of strings */
+	int ab_argc;		/* number of strings */
+};
+
+int argbuf_init(struct argbuf *ab);
+int argbuf_fromuser(struct argbuf *ab, const_userptr_t uargv);
+int argbuf_fromkernel(struct argbuf *ab, int argc, char **argv);
+int argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv);
+void argbuf_cleanup(struct argbuf *ab);
+
+
+#endif /* _ARGBUF_H_ */
@@ -38,10 +38,26 @@
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *     bitmap_alloc_near - like bitmap_alloc, but start looking at the
+ *                      given hint and wrap around, so the bit returned
+ *                      is the first clear one at or after the hint.
+ *     bitmap_alloc_range - locate COUNT consecutive cleared bits (the
+ *                      lowest such run), set them, and return the
+ *                      index of the first.
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
+ *     bitmap_unmark_range - clear COUNT set bits starting at INDEX.
  *     bitmap_isset   - return whether a particular bit is set or not.
+ *     bitmap_nfree   - return how many bits are clear.
  *     bitmap_destroy - destroy bitmap.
+ *
+ * The allocation functions return ENOSPC if there is no room.
+ *
+ * The bitmap remembers a point below which every bit is set, so
+ * bitmap_alloc doesn't rescan the full part of a map that fills from
+ * the bottom. Setting bits through the pointer from bitmap_getdata is
+ * fine (that's how a map is loaded from disk), but clearing them that
+ * way is not.
  */
 
 
@@ -50,9 +66,16 @@ struct bitmap;  /* Opaque. */
 struct bitmap *bitmap_create(unsigned nbits);
 void          *bitmap_getdata(struct bitmap *);
 int            bitmap_alloc(struct bitmap *, unsigned *index);
+int            bitmap_alloc_near(struct bitmap *, unsigned hint,
+                                 unsigned *index);
+int            bitmap_alloc_range(struct bitmap *, unsigned count,
+                                  unsigned *index);
 void           bitmap_mark(struct bitmap *, unsigned index);
 void           bitmap_unmark(struct bitmap *, unsigned index);
+void           bitmap_unmark_range(struct bitmap *, unsigned index,
+                                   unsigned count);
 int            bitmap_isset(struct bitmap *, unsigned index);
+unsigned       bitmap_nfree(struct bitmap *);
 void           bitmap_destroy(struct bitmap *);
 
 
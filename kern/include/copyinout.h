@@ -69,5 +69,31 @@ int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
 
+/*
+ * Batched versions, for system calls that move several pieces at
+ * once. These set up fault handling once for the whole batch, and
+ * check every range before copying anything, so on failure nothing
+ * has been copied unless a page turned out to be unmapped partway.
+ *
+ * copyin_batch and copyout_batch do NREQS copies, each of CR_LEN bytes
+ * between user address CR_UADDR and kernel address CR_KADDR.
+ *
+ * copyinstrs copies the strings at the N user addresses in UPTRS,
+ * stopping early at a NULL one, into DEST one after another, each
+ * with its null terminator, using at most LEN bytes. It returns in
+ * *NSTRS how many strings were copied and in *GOT how many bytes they
+ * took, even if it fails partway (with ENAMETOOLONG or EFAULT).
+ */
+struct copyreq {
+	userptr_t cr_uaddr;	/* user-space address */
+	void *cr_kaddr;		/* kernel-space address */
+	size_t cr_len;		/* length */
+};
+
+int copyin_batch(const struct copyreq *reqs, unsigned nreqs);
+int copyout_batch(const struct copyreq *reqs, unsigned nreqs);
+int copyinstrs(const userptr_t *uptrs, size_t n, char *dest, size_t len,
+	       size_t *nstrs, size_t *got);
+
 
 #endif /* _COPYINOUT_H_ */
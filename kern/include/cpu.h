@@ -34,6 +34,8 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include "opt-scstats.h"
+#include "opt-ktrace.h"
 
 
 /*
@@ -60,6 +62,7 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct kmag_cpu *c_kmag;	/* kmalloc magazines */
 
 	/*
 	 * Accessed by other cpus.
@@ -87,6 +90,21 @@ struct cpu {
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
 	struct spinlock c_ipi_lock;
+
+#if OPT_SCSTATS
+	/*
+	 * Accessed only by this cpu, with interrupts off; read by
+	 * anyone. See <scstats.h>.
+	 */
+	struct scstat *c_scstats;	/* Per-syscall counters */
+#endif
+#if OPT_KTRACE
+	/*
+	 * Written only by this cpu, with interrupts off; read by
+	 * anyone. See <ktrace.h>.
+	 */
+	struct ktrace_ring *c_ktrace;	/* Event trace records */
+#endif
 };
 
 #define TLBSHOOTDOWN_ALL  (-1)
@@ -109,6 +127,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Get the cpu whose software number is N, or NULL if there aren't
+ * that many.
+ */
+struct cpu *cpu_get(unsigned n);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -34,30 +34,91 @@
  * Devices.
  */
 
+#include <kern/ioctl.h>
+#include <spinlock.h>
 
 struct uio;  /* in <uio.h> */
 
+/*
+ * Asynchronous block I/O request, for devices that provide d_submit.
+ *
+ * The submitter fills in the first five fields and hands the request
+ * to d_submit, which queues it and returns. When the transfer is
+ * finished the device sets dr_result (0 or an error code) and calls
+ * dr_done. dr_done may be called from an interrupt handler, so it
+ * must not sleep; V() on a semaphore is the usual thing to do. The
+ * request and its buffer belong to the device until then.
+ */
+struct devreq {
+	uint32_t dr_block;		/* first block to transfer */
+	uint32_t dr_nblocks;		/* number of blocks */
+	void *dr_buf;			/* kernel buffer, dr_nblocks blocks */
+	bool dr_write;			/* true for writes */
+	void (*dr_done)(struct devreq *);  /* completion callback */
+	void *dr_data;			/* for the submitter's use */
+
+	int dr_result;			/* set on completion */
+
+	/* private to the device */
+	uint32_t dr_xfered;		/* blocks done so far */
+	struct devreq *dr_next;		/* device queue link */
+	uint64_t dr_qtime;		/* when queued (for devstats) */
+	uint64_t dr_stime;		/* when started (for devstats) */
+};
+
+/*
+ * Per-device I/O statistics. Devices that use struct devreq report
+ * each request's progress with the devstats_* calls below, which are
+ * safe to call from an interrupt handler.
+ */
+struct devstats {
+	struct spinlock ds_lock;
+	struct devstat ds_stat;
+	uint64_t ds_since;		/* time of first request, or 0 */
+};
+
 /*
  * Filesystem-namespace-accessible device.
  * d_io is for both reads and writes; the uio indicates the direction.
+ * d_submit, if not NULL, starts an asynchronous transfer; see above.
  */
 struct device {
 	int (*d_open)(struct device *, int flags_from_open);
 	int (*d_close)(struct device *);
 	int (*d_io)(struct device *, struct uio *);
 	int (*d_ioctl)(struct device *, int op, userptr_t data);
+	int (*d_submit)(struct device *, struct devreq *);
 
 	blkcnt_t d_blocks;
 	blksize_t d_blocksize;
 
 	dev_t d_devnumber;	/* serial number for this device */
 
+	struct devstats d_stats;	/* I/O statistics */
+
 	void *d_data;		/* device-specific data */
 };
 
 /* Create vnode for a vfs-level device. */
 struct vnode *dev_create_vnode(struct device *dev);
 
+/*
+ * I/O statistics.
+ *
+ *    devstats_init    - reset the counters; done by vfs_adddev.
+ *    devstats_queued  - REQ was accepted by d_submit.
+ *    devstats_started - the device started working on REQ.
+ *    devstats_done    - REQ finished (with dr_result set).
+ *    devstats_get     - take a snapshot of the counters.
+ *    devstats_print   - print a summary, under the name NAME.
+ */
+void devstats_init(struct device *dev);
+void devstats_queued(struct device *dev, struct devreq *req);
+void devstats_started(struct device *dev, struct devreq *req);
+void devstats_done(struct device *dev, struct devreq *req);
+void devstats_get(struct device *dev, struct devstat *ret);
+void devstats_print(struct device *dev, const char *name);
+
 
 /* Initialization functions for builtin vfs-level devices. */
 void devnull_create(void);
@@ -0,0 +1,69 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what open() creates: a vnode plus the access mode
+ * and the seek position. It is shared, and refcounted, by every
+ * descriptor that refers to it, whether in the same process or, after
+ * fork, in another; of_lock serializes I/O on it so that the offset
+ * stays consistent.
+ *
+ * A filetable maps descriptors to openfiles with a flat array, so
+ * looking up a descriptor is a bounds check and an index. The table
+ * belongs to a single-threaded process and has no lock of its own.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;		/* the file */
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND */
+	struct lock *of_lock;		/* protects of_offset; held for I/O */
+	off_t of_offset;		/* seek position */
+
+	struct spinlock of_reflock;	/* protects of_refcount */
+	unsigned of_refcount;		/* descriptors referring to us */
+};
+
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+/* Open PATH (which is destroyed) and wrap it in an openfile. */
+int openfile_open(char *path, int openflags, mode_t mode,
+		  struct openfile **ret);
+/* Wrap an already-open vnode; on success the openfile owns it. */
+int openfile_create(struct vnode *vn, int openflags, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * filetable_create  - make an empty table.
+ * filetable_copy    - make a table with the same descriptors as SRC,
+ *                     sharing its openfiles; for fork.
+ * filetable_destroy - close everything and free the table.
+ * filetable_get     - look up FD; EBADF if it isn't open. Does not
+ *                     add a reference.
+ * filetable_place   - install OF at the lowest free descriptor. The
+ *                     table takes over the caller's reference.
+ * filetable_placeat - install OF at FD, closing whatever was there.
+ * filetable_remove  - take FD out of the table and return its
+ *                     openfile, whose reference passes to the caller.
+ */
+struct filetable *filetable_create(void);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+void filetable_destroy(struct filetable *ft);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_placeat(struct filetable *ft, struct openfile *of, int fd);
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+
+#endif /* _FILE_H_ */
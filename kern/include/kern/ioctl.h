@@ -34,6 +34,39 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/* Get a device's I/O statistics; the argument is a struct devstat * */
+#define DIOCGSTAT	1
+
+/*
+ * Device I/O statistics, as returned by DIOCGSTAT.
+ *
+ * Times are in nanoseconds. A request's latency runs from when it is
+ * queued until it completes; of that, ds_waitns counts the part spent
+ * waiting in the queue and ds_busyns the part the device was working
+ * on it.
+ *
+ * Latency histogram: bucket 0 counts requests under 16 us; bucket i
+ * counts latencies in [2^(i+3), 2^(i+4)) us; the last bucket has
+ * everything longer. Size histogram: bucket i counts requests of
+ * [2^i, 2^(i+1)) blocks, with the last bucket again open-ended.
+ */
+#define DEVSTAT_NLAT	16
+#define DEVSTAT_NSIZE	8
+
+struct devstat {
+	__u64 ds_reads;		/* read requests completed */
+	__u64 ds_writes;	/* write requests completed */
+	__u64 ds_rblocks;	/* blocks read */
+	__u64 ds_wblocks;	/* blocks written */
+	__u64 ds_errors;	/* requests that failed */
+	__u64 ds_waitns;	/* total time queued */
+	__u64 ds_busyns;	/* total time in service */
+	__u64 ds_maxns;		/* longest latency seen */
+	__u64 ds_elapsedns;	/* time since the first request */
+	__u32 ds_qdepth;	/* requests outstanding right now */
+	__u32 ds_maxqdepth;	/* most requests ever outstanding */
+	__u32 ds_lat[DEVSTAT_NLAT];	/* latency histogram */
+	__u32 ds_size[DEVSTAT_NSIZE];	/* request size histogram */
+};
 
 #endif /* _KERN_IOCTL_H_*/
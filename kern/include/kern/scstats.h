@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SCSTATS_H_
+#define _KERN_SCSTATS_H_
+
+/*
+ * System call statistics, as returned by __scstats().
+ *
+ * There is one struct scstat per system call number, below
+ * SCSTAT_NCALLS. Times are in CPU cycles, from entering the
+ * dispatcher to leaving it. Calls that don't return (_exit, and
+ * execv when it succeeds) are counted in ss_calls but have no time.
+ *
+ * Latency histogram: bucket 0 counts calls under 256 cycles; bucket i
+ * counts [2^(i+7), 2^(i+8)) cycles; the last bucket has everything
+ * longer.
+ */
+#define SCSTAT_NCALLS	128
+#define SCSTAT_NLAT	16
+
+struct scstat {
+	__u64 ss_calls;		/* calls made */
+	__u64 ss_errors;	/* calls that failed */
+	__u64 ss_cycles;	/* total time in completed calls */
+	__u32 ss_maxcycles;	/* longest single call */
+	__u32 ss_lat[SCSTAT_NLAT];	/* latency histogram */
+};
+
+#endif /* _KERN_SCSTATS_H_ */
@@ -0,0 +1,46 @@
+#ifndef _KMEM_CACHE_H_
+#define _KMEM_CACHE_H_
+
+/*
+ * Kernel object caches.
+ *
+ * A cache hands out objects of one type and size. Each object is run
+ * through the cache's constructor once, when its memory is first
+ * obtained from kmalloc, and is expected to be handed back to
+ * kmem_cache_free in that same constructed state: locks released,
+ * lists and wait channels empty. Freed objects are kept, constructed,
+ * on a small stack in the cache and handed out again by the next
+ * kmem_cache_alloc, so the work done by the constructor (creating
+ * wait channels, allocating stacks, and so on) is paid once per
+ * object rather than once per use. Only when that stack is full does
+ * an object get destructed and its memory returned to kmalloc.
+ *
+ * The cache's NAME should be a string constant; it is used only in
+ * the statistics printed by kmem_cache_printstats (the "kh" menu
+ * command).
+ */
+
+struct kmem_cache; /* Opaque */
+
+/*
+ * kmem_cache_create     - make a cache of SIZE-byte objects. CTOR and
+ *                         DTOR may be NULL. CTOR returns 0 or an
+ *                         error code; if it fails, the allocation
+ *                         fails.
+ * kmem_cache_destroy    - destroy a cache. All its objects must have
+ *                         been freed.
+ * kmem_cache_alloc      - get a constructed object, or NULL if out of
+ *                         memory.
+ * kmem_cache_free       - give an object back.
+ * kmem_cache_printstats - print per-cache usage.
+ */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     int (*ctor)(void *obj),
+				     void (*dtor)(void *obj));
+void kmem_cache_destroy(struct kmem_cache *kc);
+void *kmem_cache_alloc(struct kmem_cache *kc);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+void kmem_cache_printstats(void);
+
+
+#endif /* _KMEM_CACHE_H_ */
@@ -0,0 +1,97 @@
+#ifndef _KTRACE_H_
+#define _KTRACE_H_
+
+/*
+ * Kernel event trace.
+ *
+ * Each CPU has a fixed-size ring of binary event records that only it
+ * writes, with interrupts off, so recording takes no lock and never
+ * waits for the console the way DEBUG() does. Once a ring is full the
+ * oldest records are overwritten. Timestamps come from the realtime
+ * clock (the ltimer, on System/161).
+ *
+ * Readers copy a ring without locking and then check its head again,
+ * discarding anything that may have been overwritten while they were
+ * copying; so a dump taken while tracing is on is consistent, if not
+ * quite up to the moment.
+ *
+ * Which events are recorded is controlled by a mask of (1 << type)
+ * bits, all off at boot; the "kt" menu command sets it and dumps the
+ * rings, either decoded on the console or streamed through the ltrace
+ * device for offline analysis.
+ *
+ * All of this is compiled in only with "options ktrace". Without it,
+ * KTRACE() expands to nothing.
+ */
+
+#include "opt-ktrace.h"
+
+struct cpu;
+
+/* Event types, and what goes in the aux and arg fields */
+#define KT_SWITCH	0	/* newstate, old thread, new thread */
+#define KT_WAKEUP	1	/* target cpu, thread woken, waker */
+#define KT_FAULT	2	/* VM_FAULT_*, address, pc */
+#define KT_SYSCALL	3	/* call number, first two args */
+#define KT_SYSRET	4	/* call number, error, return value */
+#define KT_LOCKWAIT	5	/* 0, lock, thread holding it */
+#define KT_NTYPES	6
+
+/* One record, as stored and as streamed */
+struct ktrace_event {
+	uint32_t ke_sec;		/* time */
+	uint32_t ke_nsec;
+	uint16_t ke_type;		/* KT_* */
+	uint16_t ke_aux;		/* small type-specific value */
+	uint32_t ke_arg0;		/* type-specific */
+	uint32_t ke_arg1;
+};
+
+/*
+ * Streaming through ltrace writes KTRACE_STREAM_MAGIC and the number of
+ * records to the debug register, then five words per record: (cpu << 24
+ * | type << 16 | aux), sec, nsec, arg0, arg1, oldest first; and then
+ * KTRACE_STREAM_END. System/161 logs each write.
+ */
+#define KTRACE_STREAM_MAGIC	0x6b747263	/* "ktrc" */
+#define KTRACE_STREAM_END	0x6b74656e	/* "kten" */
+
+#if OPT_KTRACE
+
+/*
+ * ktrace_cpuinit    - allocate the ring for a new CPU.
+ * ktrace_record     - record an event on this CPU's ring. Use KTRACE()
+ *                     instead, which checks the mask first.
+ * ktrace_setmask    - choose which types to record.
+ * ktrace_typebyname - get the KT_* type called NAME, or -1.
+ * ktrace_clear      - forget everything recorded so far.
+ * ktrace_print      - decode the rings, merged in time order, to the
+ *                     console.
+ * ktrace_stream     - write the rings out through ltrace.
+ */
+void ktrace_cpuinit(struct cpu *c);
+void ktrace_record(unsigned type, unsigned aux, uint32_t arg0, uint32_t arg1);
+void ktrace_setmask(uint32_t mask);
+int ktrace_typebyname(const char *name);
+void ktrace_clear(void);
+void ktrace_print(void);
+void ktrace_stream(void);
+
+extern volatile uint32_t ktrace_mask;
+
+#define KTRACE(type, aux, arg0, arg1) \
+	do { \
+		if (ktrace_mask & (1U << (type))) { \
+			ktrace_record(type, aux, (uint32_t)(arg0), \
+				      (uint32_t)(arg1)); \
+		} \
+	} while (0)
+
+#else
+
+#define KTRACE(type, aux, arg0, arg1)	((void)0)
+
+#endif /* OPT_KTRACE */
+
+
+#endif /* _KTRACE_H_ */
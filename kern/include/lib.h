@@ -122,10 +122,17 @@ uint32_t random(void);
 /*
  * Kernel heap memory allocation. Like malloc/free.
  * If out of memory, kmalloc returns NULL.
+ *
+ * krealloc is like realloc, except that it must be told the block's
+ * current size (what it was allocated or last resized with).
  */
 void *kmalloc(size_t size);
 void kfree(void *ptr);
+void *krealloc(void *ptr, size_t oldsize, size_t newsize);
 void kheap_printstats(void);
+/* Called by cpu_create to set up per-cpu kmalloc state. */
+struct cpu;
+void kmalloc_cpuinit(struct cpu *c);
 
 /*
  * C string functions. 
@@ -175,7 +182,13 @@ void beep(void);
  *
  * kprintf_bootstrap sets up a lock for kprintf and should be called
  * during boot once malloc is available and before any additional
- * threads are created.
+ * threads are created. With "options asyncprintf", it also starts a
+ * thread that drains a buffer kprintf writes into; until then, and
+ * after a panic or kprintf_sync, output is synchronous.
+ *
+ * kprintf_flush waits for buffered output to reach the console.
+ * kprintf_sync flushes and goes back to synchronous output.
+ * kprintf_wakeup is for hardclock; see kprintf.c.
  */
 int kprintf(const char *format, ...) __PF(1,2);
 void panic(const char *format, ...) __PF(1,2);
@@ -184,6 +197,9 @@ void badassert(const char *expr, const char *file, int line, const char *func);
 void kgets(char *buf, size_t maxbuflen);
 
 void kprintf_bootstrap(void);
+void kprintf_flush(void);
+void kprintf_sync(void);
+void kprintf_wakeup(void);
 
 /*
  * Other miscellaneous stuff
@@ -0,0 +1,59 @@
+#ifndef _MMAP_H_
+#define _MMAP_H_
+
+/*
+ * Memory-mapped regions of a user address space.
+ *
+ * Each mmap() call makes one region: a run of pages, all with the
+ * same protection, backed either by a vnode (starting at mr_offset) or
+ * by nothing (MAP_ANON). Pages are allocated and filled from the file
+ * on first touch. Pages of a writable MAP_SHARED file mapping are
+ * entered in the TLB read-only until they are first written, so that
+ * only pages that were actually changed get written back; that happens
+ * when the region is unmapped or the address space is destroyed.
+ *
+ * An address space's regions are kept on a list sorted by address.
+ * They are placed top-down, starting just under the stack.
+ */
+
+#include <vm.h>
+
+struct addrspace;
+struct vnode;
+
+struct mmap_region {
+	vaddr_t mr_base;		/* first address */
+	unsigned mr_npages;		/* length in pages */
+	int mr_prot;			/* PROT_* */
+	int mr_flags;			/* MAP_* */
+	struct vnode *mr_vnode;		/* backing file, or NULL */
+	off_t mr_offset;		/* file offset of mr_base */
+	paddr_t *mr_pages;		/* per page: frame | MMAP_PG_*, or 0 */
+	struct mmap_region *mr_next;	/* next region up */
+};
+
+/* Flag kept in the low bits of mr_pages[] entries */
+#define MMAP_PG_DIRTY	0x1		/* written since it was read in */
+
+/*
+ * mmap_create     - add a region of LEN bytes; VN, if not NULL, must be
+ *                   open, and the region takes its own reference.
+ *                   Returns the address in *RET.
+ * mmap_remove     - unmap all pages in [ADDR, ADDR+LEN), splitting
+ *                   regions as needed. The caller flushes the TLB.
+ * mmap_fault      - handle a fault on a mapped page. On success hands
+ *                   back the frame and whether it may be entered in
+ *                   the TLB writable.
+ * mmap_copy       - copy OLD's regions into NEW, for fork.
+ * mmap_destroyall - unmap everything, for as_destroy.
+ */
+int mmap_create(struct addrspace *as, size_t len, int prot, int flags,
+		struct vnode *vn, off_t offset, vaddr_t *ret);
+int mmap_remove(struct addrspace *as, vaddr_t addr, size_t len);
+int mmap_fault(struct addrspace *as, int faulttype, vaddr_t va,
+	       paddr_t *ret, bool *writable);
+int mmap_copy(struct addrspace *old, struct addrspace *new);
+void mmap_destroyall(struct addrspace *as);
+
+
+#endif /* _MMAP_H_ */
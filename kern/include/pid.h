@@ -0,0 +1,28 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+/*
+ * The process ID table.
+ *
+ * PIDs between PID_MIN and PID_MAX are handed out from a bitmap,
+ * starting just past the last one allocated and wrapping around, so a
+ * PID isn't reused until the rest of the space has been cycled
+ * through. A PID stays allocated until its proc is destroyed, which
+ * for a process with a parent is when the parent reaps it. A flat
+ * array maps PIDs to their procs.
+ *
+ * pid_bootstrap - set up the table.
+ * pid_alloc     - get a PID for PROC. ENPROC if there are none left.
+ * pid_lookup    - return the proc with PID, or NULL.
+ * pid_free      - release PID for reuse.
+ */
+
+struct proc;
+
+void pid_bootstrap(void);
+int pid_alloc(struct proc *proc, pid_t *ret);
+struct proc *pid_lookup(pid_t pid);
+void pid_free(pid_t pid);
+
+
+#endif /* _PID_H_ */
@@ -0,0 +1,16 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes (kern/vfs/pipe.c).
+ *
+ * pipe_create makes a pipe and returns its read and write ends as
+ * vnodes, already open; release them with vfs_close.
+ */
+
+struct vnode;
+
+int pipe_create(struct vnode **rret, struct vnode **wret);
+
+
+#endif /* _PIPE_H_ */
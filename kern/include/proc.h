@@ -43,30 +43,50 @@
 
 struct addrspace;
 struct vnode;
+struct filetable;
 #ifdef UW
 struct semaphore;
 #endif // UW
 
-// important info about process (addr of proc and error code if it exits)
-#if OPT_A2
-struct proc_info {
-  struct proc * proc_addr;
-  pid_t pid;
-  int exit_code;
-};
-#endif
-
 /*
  * Process structure.
  */
 struct proc {
 #if OPT_A2
   pid_t pid;
-  struct array* children_info; // holds addresses to proc_info structs
-  struct cv *is_dying;
-  struct lock *child_lock; // many children could be modifying children_info array
-  struct proc *parent;
   struct trapframe *tf;
+
+  /*
+   * Parent/child links and exit status; protected by the global
+   * proc_waitlock. A process that exits while its parent is still
+   * around becomes a zombie: everything but this part is released,
+   * and the parent reaps it with waitpid. Exited children are moved
+   * to a list of their own so that waiting for any child doesn't have
+   * to search.
+   */
+  struct proc *parent;          /* NULL if orphaned */
+  struct proc *p_children;      /* running children */
+  struct proc *p_zombies;       /* exited children not yet reaped */
+  struct proc *p_nextsib;       /* next on the parent's list */
+  struct proc *p_prevsib;       /* previous on the parent's list */
+  struct cv *p_waitcv;          /* signalled when a child exits */
+  bool p_exited;                /* zombie */
+  int p_exitstatus;             /* waitpid status, once exited */
+
+  /*
+   * Set while a vfork child is running in its parent's address
+   * space; V'd, and cleared, when the child execs or exits and gives
+   * the address space back.
+   */
+  struct semaphore *p_vfork;
+
+  /*
+   * Resource usage of threads that have left the process, and of
+   * reaped children and their descendants. p_ru is protected by
+   * p_lock; p_ruchildren by proc_waitlock.
+   */
+  struct ru_counts p_ru;
+  struct ru_counts p_ruchildren;
 #endif
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
@@ -78,7 +98,9 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
-#ifdef UW
+#if OPT_A2
+	struct filetable *p_fdtable;	/* open file descriptors */
+#elif defined(UW)
   /* a vnode to refer to the console device */
   /* this is a quick-and-dirty way to get console writes working */
   /* you will probably need to change this when implementing file-related
@@ -123,4 +145,31 @@ struct addrspace *curproc_setas(struct addrspace *);
 /* Set the address space of proc, return old one */
 struct addrspace * proc_setas(struct addrspace *newas, struct proc *proc);
 
+#if OPT_A2
+/* Make CHILD a child of PARENT, for fork. */
+void proc_addchild(struct proc *parent, struct proc *child);
+
+/*
+ * Called by an exiting process, once its thread is detached, with its
+ * waitpid status. Orphans its children, reaping those that have
+ * already exited. Returns true if PROC is now a zombie for its parent
+ * to reap; otherwise the caller should destroy it.
+ */
+bool proc_exited(struct proc *proc, int status);
+
+/*
+ * Wait for child PID (or any child, for WAIT_ANY) of the current
+ * process to exit and reap it, returning its PID and status. With
+ * WNOHANG, returns PID 0 if no such child has exited yet. The child's
+ * resource usage, including that of its own reaped children, is added
+ * to the caller's p_ruchildren, and also returned in *RU if RU isn't
+ * NULL.
+ */
+int proc_wait(pid_t pid, int options, pid_t *retpid, int *status,
+              struct ru_counts *ru);
+
+/* Get the current process's own resource usage so far. */
+void proc_getrusage(struct ru_counts *ru);
+#endif
+
 #endif /* _PROC_H_ */
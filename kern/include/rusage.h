@@ -0,0 +1,46 @@
+#ifndef _RUSAGE_H_
+#define _RUSAGE_H_
+
+/*
+ * Resource usage accounting.
+ *
+ * Each thread counts what it uses in its own t_ru, which only the
+ * thread itself (or an interrupt on its CPU while it is running)
+ * touches, so no locking is needed to charge it. When a thread leaves
+ * its process, its counts are added into the process's. getrusage and
+ * wait4 convert the counts to a struct rusage.
+ *
+ * CPU time is sampled: each hardclock() charges one tick, to user or
+ * system time depending on what it interrupted.
+ */
+
+struct rusage;
+
+struct ru_counts {
+	uint32_t ru_uticks;		/* hardclocks taken in user mode */
+	uint32_t ru_sticks;		/* hardclocks taken in the kernel */
+	uint32_t ru_nvcsw;		/* slept or yielded */
+	uint32_t ru_nivcsw;		/* preempted */
+	uint32_t ru_tlbfaults;		/* vm_fault calls */
+	uint32_t ru_pagefaults;		/* pages read in or zero-filled */
+	uint32_t ru_inblock;		/* filesystem blocks read */
+	uint32_t ru_oublock;		/* filesystem blocks written */
+};
+
+/*
+ * Charge N to FIELD of the current thread's counts. Needs <current.h>
+ * and <thread.h>.
+ */
+#define RU_CHARGE(field, n)	(curthread->t_ru.field += (n))
+
+/*
+ * ru_init     - zero the counts.
+ * ru_add      - add FROM into TO.
+ * ru_torusage - convert to a struct rusage for user level.
+ */
+void ru_init(struct ru_counts *ru);
+void ru_add(struct ru_counts *to, const struct ru_counts *from);
+void ru_torusage(const struct ru_counts *ru, struct rusage *ret);
+
+
+#endif /* _RUSAGE_H_ */
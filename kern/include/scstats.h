@@ -0,0 +1,48 @@
+#ifndef _SCSTATS_H_
+#define _SCSTATS_H_
+
+/*
+ * System call statistics.
+ *
+ * Each CPU has its own table of counters, indexed by call number, that
+ * only it writes; the dispatcher updates it with interrupts off instead
+ * of taking a lock. Readers add up all the CPUs' tables without
+ * locking, so a snapshot taken while calls are running may be a little
+ * inconsistent.
+ *
+ * All of this is compiled in only with "options scstats". Without it,
+ * SCSTATS_ENTER and SCSTATS_EXIT expand to nothing.
+ */
+
+#include <kern/scstats.h>
+#include "opt-scstats.h"
+
+struct cpu;
+
+#if OPT_SCSTATS
+
+/*
+ * scstats_cpuinit - allocate the table for a new CPU.
+ * scstats_enter   - count a call to CALLNO.
+ * scstats_exit    - record that CALLNO returned ERR after CYCLES cycles.
+ * scstats_get     - add up the tables for calls [0, NCALLS) into RET.
+ * scstats_print   - print a summary of the calls that have been made.
+ */
+void scstats_cpuinit(struct cpu *c);
+void scstats_enter(int callno);
+void scstats_exit(int callno, int err, uint32_t cycles);
+void scstats_get(struct scstat *ret, unsigned ncalls);
+void scstats_print(void);
+
+#define SCSTATS_ENTER(callno)			scstats_enter(callno)
+#define SCSTATS_EXIT(callno, err, cycles)	scstats_exit(callno, err, cycles)
+
+#else
+
+#define SCSTATS_ENTER(callno)			((void)0)
+#define SCSTATS_EXIT(callno, err, cycles)	((void)0)
+
+#endif /* OPT_SCSTATS */
+
+
+#endif /* _SCSTATS_H_ */
@@ -48,11 +48,64 @@
  */
 #include <kern/sfs.h>
 
+/*
+ * Number of blocks reserved past the end of a file that is being
+ * written sequentially, so that concurrent writers do not interleave
+ * their blocks. The reservation lives only in memory (the blocks are
+ * marked in the freemap) and is given back on fsync and reclaim.
+ */
+#define SFS_PREALLOC      8
+
+/*
+ * Read-ahead for files being read sequentially. The window starts at
+ * SFS_RAMIN blocks and doubles on every sequential read up to
+ * SFS_RAMAX, which is also the size of the per-file buffer.
+ *
+ * Blocks are kept in a ring of SFS_RAMAX slots indexed by file block
+ * number: [ra_start, ra_end) is buffered and [ra_end, ra_pend) has
+ * been handed to the prefetch thread. ra_inflight is set while that
+ * thread is reading from the disk; it does so without the vfs big
+ * lock, so anyone who needs to wait for it sleeps on ra_cv.
+ */
+#define SFS_RAMIN         2
+#define SFS_RAMAX         16
+
+struct sfs_rabuf {
+	struct lock *ra_lock;           /* protects the fields below */
+	struct cv *ra_cv;               /* signalled when a fetch ends */
+	char *ra_data;                  /* SFS_RAMAX blocks of file data */
+	uint32_t ra_start;              /* first buffered file block */
+	uint32_t ra_end;                /* first block not buffered */
+	uint32_t ra_pend;               /* end of the block being fetched */
+	bool ra_inflight;               /* prefetch I/O in progress */
+};
+
+/*
+ * Write-behind buffer for regular files. Holds file blocks
+ * [wb_start, wb_end), which have not been written to disk and may
+ * not have disk blocks allocated yet, in a ring of SFS_WBMAX slots.
+ * Dirty data is flushed at least every SFS_SYNCSECS seconds.
+ */
+#define SFS_WBMAX         16
+#define SFS_SYNCSECS      5
+
+struct sfs_wbuf {
+	char *wb_data;                  /* SFS_WBMAX blocks of file data */
+	uint32_t wb_start;              /* first buffered file block */
+	uint32_t wb_end;                /* first block not buffered */
+};
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	uint32_t sv_prealloc;           /* first reserved block, if any */
+	uint32_t sv_npreallocs;         /* number of reserved blocks */
+	uint32_t sv_ranext;             /* block a sequential read hits next */
+	uint32_t sv_rawindow;           /* read-ahead window, in blocks */
+	struct sfs_rabuf *sv_ra;        /* read-ahead buffer, or NULL */
+	struct sfs_wbuf *sv_wb;         /* write-behind buffer, or NULL */
 };
 
 struct sfs_fs {
@@ -87,5 +140,32 @@ int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
+/*
+ * Map a file block to a disk block, allocating it if DOALLOC is set.
+ * With SFS_BMAP_NOCLEAR, a new block isn't zeroed first; use it only
+ * when about to write the whole block.
+ */
+#define SFS_BMAP_NOCLEAR 2
+int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
+	     uint32_t *diskblock);
+
+/* Read-ahead (sfs_readahead.c) */
+int sfs_ra_bootstrap(void);
+bool sfs_ra_read(struct sfs_vnode *sv, uint32_t fileblock,
+		 uint32_t skip, uint32_t len, struct uio *uio, int *result);
+void sfs_ra_update(struct sfs_vnode *sv, off_t pos, off_t endpos);
+void sfs_ra_invalidate(struct sfs_vnode *sv);
+void sfs_ra_destroy(struct sfs_vnode *sv);
+
+/* Write-behind (sfs_writeback.c) */
+int sfs_wb_bootstrap(void);
+bool sfs_wb_write(struct sfs_vnode *sv, uint32_t fileblock,
+		  uint32_t skip, uint32_t len, struct uio *uio, int *result);
+bool sfs_wb_read(struct sfs_vnode *sv, uint32_t fileblock,
+		 uint32_t skip, uint32_t len, struct uio *uio, int *result);
+int sfs_wb_flush(struct sfs_vnode *sv);
+void sfs_wb_truncate(struct sfs_vnode *sv, uint32_t blocklen);
+void sfs_wb_destroy(struct sfs_vnode *sv);
+
 
 #endif /* _SFS_H_ */
@@ -142,5 +142,11 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * Set up the object caches the primitives above are allocated from.
+ * Called once during boot, before any of them are created.
+ */
+void synch_bootstrap(void);
+
 
 #endif /* _SYNCH_H_ */
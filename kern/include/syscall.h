@@ -57,14 +57,37 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys___scstats(userptr_t buf, unsigned ncalls, int *retval);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
+int sys_wait4(pid_t pid, userptr_t status, int options, userptr_t urusage,
+              pid_t *retval);
+int sys_getrusage(int who, userptr_t urusage);
 int sys_fork(struct trapframe * tf, pid_t *retval);
-int sys_execv(const char * program_name, char ** args);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_execv(userptr_t uprogname, userptr_t uargv);
+int sys_open(userptr_t upath, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+              int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+               int *retval);
+int sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_preadv(int fdesc, const_userptr_t uiov, int iovcnt, off_t pos,
+               int *retval);
+int sys_pwritev(int fdesc, const_userptr_t uiov, int iovcnt, off_t pos,
+                int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_close(int fdesc);
+int sys_pipe(userptr_t ufds);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fdesc,
+             off_t offset, int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
 
 #endif // UW
 
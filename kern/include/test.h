@@ -79,6 +79,9 @@ int printfile(int, char **);
 /* other tests */
 int malloctest(int, char **);
 int mallocstress(int, char **);
+int mallocbig(int, char **);
+int mallocrealloc(int, char **);
+int membench(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <rusage.h>
 
 struct cpu;
 
@@ -101,6 +102,14 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Resource usage. t_intr_fromuser is true while handling an
+	 * interrupt that was taken in user mode, so hardclock() knows
+	 * whose time it is.
+	 */
+	bool t_intr_fromuser;		/* Interrupted user mode? */
+	struct ru_counts t_ru;		/* What we've used so far */
+
 	/*
 	 * Public fields
 	 */
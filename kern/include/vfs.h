@@ -157,6 +157,8 @@ int vfs_getcwd(struct uio *buf);
  *                    specified device.
  *
  *    vfs_unmountall - Unmount all mounted filesystems.
+ *
+ *    vfs_iostat    - Print I/O statistics for all block devices.
  */
 
 void vfs_bootstrap(void);
@@ -173,6 +175,7 @@ int vfs_mount(const char *devname, void *data,
 			       struct fs **result));
 int vfs_unmount(const char *devname);
 int vfs_unmountall(void);
+void vfs_iostat(void);
 
 /*
  * Array of vnodes.
@@ -55,6 +55,28 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
 
+/*
+ * alloc_kvpages - allocate pages that are contiguous in kernel virtual
+ *                 memory but not necessarily in physical memory, for
+ *                 when alloc_kpages can't find a long enough run.
+ *                 Freed with free_kpages. Returns 0 if there's no room
+ *                 or the VM system doesn't support it.
+ * grow_kpages   - extend an allocation from either of the above from
+ *                 OLDNPAGES to NEWNPAGES in place; returns false if the
+ *                 pages after it aren't free.
+ */
+vaddr_t alloc_kvpages(unsigned npages);
+bool grow_kpages(vaddr_t addr, unsigned oldnpages, unsigned newnpages);
+
+/*
+ * A word of kmalloc's own for each kernel page, kept in the coremap,
+ * so kfree can find what a pointer belongs to without searching.
+ * Freeing a page clears its tag. kpage_gettag returns false for pages
+ * that aren't tracked, such as ones allocated before vm_bootstrap.
+ */
+void kpage_settag(vaddr_t kva, void *tag);
+bool kpage_gettag(vaddr_t kva, void **tag);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown_all(void);
 void vm_tlbshootdown(const struct tlbshootdown *);
@@ -89,18 +89,15 @@ array_setsize(struct array *a, unsigned num)
 		}
 
 		/*
-		 * We don't have krealloc, and it wouldn't be
-		 * worthwhile to implement just for this. So just
-		 * allocate a new block and copy. (Exercise: what
-		 * about this and/or kmalloc makes it not worthwhile?)
+		 * krealloc leaves the array where it is when the
+		 * block has room to spare or can grow into the pages
+		 * after it, and otherwise copies.
 		 */
-
-		newptr = kmalloc(newmax*sizeof(*a->v));
+		newptr = krealloc(a->v, a->max*sizeof(*a->v),
+				  newmax*sizeof(*a->v));
 		if (newptr == NULL) {
 			return ENOMEM;
 		}
-		memcpy(newptr, a->v, a->num*sizeof(*a->v));
-		kfree(a->v);
 		a->v = newptr;
 		a->max = newmax;
 	}
@@ -34,6 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <endian.h>
 #include <bitmap.h>
 
 /*
@@ -47,43 +48,128 @@
 #define WORD_TYPE       unsigned char
 #define WORD_ALLBITS    (0xff)
 
+/*
+ * We do, however, search the map 32 bits at a time. The bytes are
+ * stored in an array of uint32_t, padded out at the end with set
+ * bits, and a chunk read from it is treated as little-endian, so that
+ * bit N of the map is bit N%32 of chunk N/32 regardless of the byte
+ * order of the machine. Whether a chunk is all clear or all set
+ * doesn't depend on byte order at all, so only chunks that the search
+ * actually stops in need to be swapped.
+ */
+#define BITS_PER_CHUNK  32
+#define CHUNK_ALLBITS   0xffffffffU
+
 struct bitmap {
         unsigned nbits;
-        WORD_TYPE *v;
+        unsigned nchunks;
+        unsigned firstfree;     /* no clear bits below this one */
+        uint32_t *chunks;
+        WORD_TYPE *v;           /* the same storage, as bytes */
 };
 
+static
+inline
+uint32_t
+bitmap_chunk(const struct bitmap *b, unsigned cx)
+{
+#if _BYTE_ORDER == _BIG_ENDIAN
+        return bswap32(b->chunks[cx]);
+#else
+        return b->chunks[cx];
+#endif
+}
+
+/*
+ * Population count, the usual way: add up adjacent bits, then pairs,
+ * then nibbles, then let a multiply sum the bytes.
+ */
+static
+inline
+unsigned
+bitmap_popcount(uint32_t x)
+{
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        x = (x + (x >> 4)) & 0x0f0f0f0f;
+        return (x * 0x01010101) >> 24;
+}
+
+/*
+ * Index of the lowest set bit of X, which must be nonzero. X & -X
+ * isolates that bit; subtracting one leaves exactly as many ones
+ * below it as its index. (The MIPS-I has no count-zeros instruction.)
+ */
+static
+inline
+unsigned
+bitmap_ctz(uint32_t x)
+{
+        KASSERT(x != 0);
+        return bitmap_popcount((x & -x) - 1);
+}
+
+/*
+ * Return the first bit at or after START that is set (if WANTSET) or
+ * clear (if not), or b->nbits if there isn't one.
+ */
+static
+unsigned
+bitmap_scan(const struct bitmap *b, unsigned start, bool wantset)
+{
+        uint32_t flip = wantset ? 0 : CHUNK_ALLBITS;
+        uint32_t c;
+        unsigned cx, bit;
+
+        if (start >= b->nbits) {
+                return b->nbits;
+        }
+
+        /* Flip so that we're always looking for a one. */
+        cx = start / BITS_PER_CHUNK;
+        c = (bitmap_chunk(b, cx) ^ flip) &
+                (CHUNK_ALLBITS << (start % BITS_PER_CHUNK));
+        while (c == 0) {
+                cx++;
+                if (cx >= b->nchunks) {
+                        return b->nbits;
+                }
+                if ((b->chunks[cx] ^ flip) != 0) {
+                        c = bitmap_chunk(b, cx) ^ flip;
+                }
+        }
+
+        /* The padding at the end is set; don't return it. */
+        bit = cx * BITS_PER_CHUNK + bitmap_ctz(c);
+        return bit < b->nbits ? bit : b->nbits;
+}
 
 struct bitmap *
 bitmap_create(unsigned nbits)
 {
         struct bitmap *b; 
-        unsigned words;
+        unsigned j, nchunks;
 
-        words = DIVROUNDUP(nbits, BITS_PER_WORD);
+        nchunks = DIVROUNDUP(nbits, BITS_PER_CHUNK);
         b = kmalloc(sizeof(struct bitmap));
         if (b == NULL) {
                 return NULL;
         }
-        b->v = kmalloc(words*sizeof(WORD_TYPE));
-        if (b->v == NULL) {
+        b->chunks = kmalloc(nchunks*sizeof(uint32_t));
+        if (b->chunks == NULL) {
                 kfree(b);
                 return NULL;
         }
+        b->v = (WORD_TYPE *)b->chunks;
 
-        bzero(b->v, words*sizeof(WORD_TYPE));
+        bzero(b->chunks, nchunks*sizeof(uint32_t));
         b->nbits = nbits;
+        b->nchunks = nchunks;
+        b->firstfree = 0;
 
         /* Mark any leftover bits at the end in use */
-        if (words > nbits / BITS_PER_WORD) {
-                unsigned j, ix = words-1;
-                unsigned overbits = nbits - ix*BITS_PER_WORD;
-
-                KASSERT(nbits / BITS_PER_WORD == words-1);
-                KASSERT(overbits > 0 && overbits < BITS_PER_WORD);
-                
-                for (j=overbits; j<BITS_PER_WORD; j++) {
-                        b->v[ix] |= ((WORD_TYPE)1 << j);
-                }
+        for (j=nbits; j<nchunks*BITS_PER_CHUNK; j++) {
+                b->v[j / BITS_PER_WORD] |= ((WORD_TYPE)1 << (j % BITS_PER_WORD));
         }
 
         return b;
@@ -95,31 +181,6 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
-int
-bitmap_alloc(struct bitmap *b, unsigned *index)
-{
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
-
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
-                                        return 0;
-                                }
-                        }
-                        KASSERT(0);
-                }
-        }
-        return ENOSPC;
-}
-
 static
 inline
 void
@@ -131,6 +192,108 @@ bitmap_translate(unsigned bitno, unsigned *ix, WORD_TYPE *mask)
         *mask = ((WORD_TYPE)1) << offset;
 }
 
+/*
+ * Set a bit that bitmap_scan found clear, and keep firstfree up to date.
+ */
+static
+void
+bitmap_take(struct bitmap *b, unsigned index)
+{
+        unsigned ix;
+        WORD_TYPE mask;
+
+        KASSERT(index < b->nbits);
+        bitmap_translate(index, &ix, &mask);
+        KASSERT((b->v[ix] & mask)==0);
+        b->v[ix] |= mask;
+        if (index == b->firstfree) {
+                b->firstfree = index + 1;
+        }
+}
+
+int
+bitmap_alloc(struct bitmap *b, unsigned *index)
+{
+        unsigned bit;
+
+        bit = bitmap_scan(b, b->firstfree, false);
+        if (bit >= b->nbits) {
+                b->firstfree = b->nbits;
+                return ENOSPC;
+        }
+        b->firstfree = bit;
+        bitmap_take(b, bit);
+        *index = bit;
+        return 0;
+}
+
+int
+bitmap_alloc_near(struct bitmap *b, unsigned hint, unsigned *index)
+{
+        unsigned bit;
+
+        if (hint >= b->nbits) {
+                hint = 0;
+        }
+
+        /*
+         * Look from the hint to the end, then wrap around to the
+         * start of the map; nothing below firstfree can be clear.
+         */
+        bit = bitmap_scan(b, hint, false);
+        if (bit >= b->nbits && b->firstfree < hint) {
+                bit = bitmap_scan(b, b->firstfree, false);
+        }
+        if (bit >= b->nbits) {
+                return ENOSPC;
+        }
+        bitmap_take(b, bit);
+        *index = bit;
+        return 0;
+}
+
+int
+bitmap_alloc_range(struct bitmap *b, unsigned count, unsigned *index)
+{
+        unsigned start, end, i, ix;
+
+        KASSERT(count > 0);
+
+        /* First fit: find a clear bit, then how far the run goes. */
+        start = b->firstfree;
+        while (1) {
+                start = bitmap_scan(b, start, false);
+                if (start >= b->nbits || b->nbits - start < count) {
+                        return ENOSPC;
+                }
+                end = bitmap_scan(b, start, true);
+                if (end - start >= count) {
+                        break;
+                }
+                start = end;
+        }
+
+        /* Mark it, a byte at a time where we can. */
+        for (i = start; i < start + count; ) {
+                if (i % BITS_PER_WORD == 0 && start + count - i >= BITS_PER_WORD) {
+                        ix = i / BITS_PER_WORD;
+                        KASSERT(b->v[ix] == 0);
+                        b->v[ix] = WORD_ALLBITS;
+                        i += BITS_PER_WORD;
+                }
+                else {
+                        bitmap_take(b, i);
+                        i++;
+                }
+        }
+        if (b->firstfree >= start && b->firstfree < start + count) {
+                b->firstfree = start + count;
+        }
+
+        *index = start;
+        return 0;
+}
+
 void
 bitmap_mark(struct bitmap *b, unsigned index)
 {
@@ -155,6 +318,20 @@ bitmap_unmark(struct bitmap *b, unsigned index)
 
         KASSERT((b->v[ix] & mask)!=0);
         b->v[ix] &= ~mask;
+        if (index < b->firstfree) {
+                b->firstfree = index;
+        }
+}
+
+void
+bitmap_unmark_range(struct bitmap *b, unsigned index, unsigned count)
+{
+        unsigned i;
+
+        KASSERT(index + count <= b->nbits);
+        for (i = index; i < index + count; i++) {
+                bitmap_unmark(b, i);
+        }
 }
 
 
@@ -168,9 +345,21 @@ bitmap_isset(struct bitmap *b, unsigned index)
         return (b->v[ix] & mask);
 }
 
+unsigned
+bitmap_nfree(struct bitmap *b)
+{
+        unsigned cx, nset = 0;
+
+        /* Byte order doesn't matter for counting. */
+        for (cx = 0; cx < b->nchunks; cx++) {
+                nset += bitmap_popcount(b->chunks[cx]);
+        }
+        return b->nchunks * BITS_PER_CHUNK - nset;
+}
+
 void
 bitmap_destroy(struct bitmap *b)
 {
-        kfree(b->v);
+        kfree(b->chunks);
         kfree(b);
 }
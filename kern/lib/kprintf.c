@@ -36,7 +36,9 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <wchan.h>
 #include <vfs.h>          // for vfs_sync()
+#include "opt-asyncprintf.h"
 
 
 /* Flags word for DEBUG() macro. */
@@ -48,6 +50,40 @@ static struct lock *kprintf_lock;
 /* Lock for polled kprintfs */
 static struct spinlock kprintf_spinlock;
 
+#if OPT_ASYNCPRINTF
+/*
+ * Output buffer. Once the drain thread is running, kprintf formats
+ * into this instead of the console, and the drain thread copies it
+ * out at whatever speed the console goes. The indexes run freely and
+ * are taken mod KPRINTF_BUFSIZE.
+ *
+ * kprintf_buflock is held only to copy bytes in or out and to sleep
+ * and wake; never across console output. The tail only moves past
+ * bytes once they have actually gone to the console.
+ */
+#define KPRINTF_BUFSIZE  16384	/* power of 2 */
+#define KPRINTF_CHUNK    128	/* bytes moved at a time */
+
+static char kprintf_buf[KPRINTF_BUFSIZE];
+static volatile unsigned kprintf_head;	/* next byte to fill */
+static volatile unsigned kprintf_tail;	/* next byte to send */
+static bool kprintf_draining;		/* drain thread is sending */
+static unsigned kprintf_lost;		/* bytes dropped when full */
+static struct spinlock kprintf_buflock;
+static struct wchan *kprintf_datawc;	/* drain thread waits for data */
+static struct wchan *kprintf_spacewc;	/* writers wait for space */
+
+/* True while output goes through kprintf_buf */
+static volatile bool kprintf_async;
+
+/* Formatting state for one kprintf call */
+struct kprintf_chunk {
+	size_t kc_len;
+	bool kc_canwait;
+	char kc_data[KPRINTF_CHUNK];
+};
+#endif
+
 
 /*
  * Warning: all this has to work from interrupt handlers and when
@@ -55,6 +91,244 @@ static struct spinlock kprintf_spinlock;
  */
 
 
+#if OPT_ASYNCPRINTF
+/*
+ * Add LEN bytes to the buffer. If it's full, wait for the drain
+ * thread if we can sleep, and otherwise drop what doesn't fit.
+ *
+ * Waking the drain thread needs the run queue lock, which someone
+ * printing with a spinlock held might already have; in that case we
+ * leave it to the next kprintf or hardclock to do it. For the same
+ * reason nobody wakes anyone while holding kprintf_buflock.
+ */
+static
+void
+kprintf_append(const char *data, size_t len, bool canwait)
+{
+	unsigned pos, n;
+
+	spinlock_acquire(&kprintf_buflock);
+	while (len > 0) {
+		n = KPRINTF_BUFSIZE - (kprintf_head - kprintf_tail);
+		if (n == 0) {
+			if (!canwait) {
+				kprintf_lost += len;
+				break;
+			}
+			wchan_lock(kprintf_spacewc);
+			spinlock_release(&kprintf_buflock);
+			wchan_sleep(kprintf_spacewc);
+			spinlock_acquire(&kprintf_buflock);
+			continue;
+		}
+		pos = kprintf_head % KPRINTF_BUFSIZE;
+		if (n > KPRINTF_BUFSIZE - pos) {
+			n = KPRINTF_BUFSIZE - pos;
+		}
+		if (n > len) {
+			n = len;
+		}
+		memcpy(kprintf_buf + pos, data, n);
+		kprintf_head += n;
+		data += n;
+		len -= n;
+	}
+	spinlock_release(&kprintf_buflock);
+
+	if (canwait) {
+		wchan_wakeone(kprintf_datawc);
+	}
+}
+
+/*
+ * Backend for __printf in buffered mode: collect output in the
+ * chunk and hand it to kprintf_append a chunk at a time.
+ */
+static
+void
+kprintf_chunk_send(void *vkc, const char *data, size_t len)
+{
+	struct kprintf_chunk *kc = vkc;
+	size_t n;
+
+	while (len > 0) {
+		if (kc->kc_len == KPRINTF_CHUNK) {
+			kprintf_append(kc->kc_data, kc->kc_len, kc->kc_canwait);
+			kc->kc_len = 0;
+		}
+		n = KPRINTF_CHUNK - kc->kc_len;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(kc->kc_data + kc->kc_len, data, n);
+		kc->kc_len += n;
+		data += n;
+		len -= n;
+	}
+}
+
+/*
+ * Drain thread: copy the buffer to the console. The console sleeps
+ * between characters, so this is the thread that goes at serial
+ * speed, instead of whoever called kprintf.
+ */
+static
+void
+kprintf_drain(void *junk1, unsigned long junk2)
+{
+	char chunk[KPRINTF_CHUNK];
+	unsigned tail, pos, n, i, lost;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		spinlock_acquire(&kprintf_buflock);
+		kprintf_draining = false;
+		spinlock_release(&kprintf_buflock);
+		wchan_wakeall(kprintf_spacewc);
+
+		spinlock_acquire(&kprintf_buflock);
+		while (kprintf_head == kprintf_tail) {
+			wchan_lock(kprintf_datawc);
+			spinlock_release(&kprintf_buflock);
+			wchan_sleep(kprintf_datawc);
+			spinlock_acquire(&kprintf_buflock);
+		}
+		/*
+		 * Leave the tail alone until the chunk is out, so that
+		 * if we're stopped partway by a panic the polled drain
+		 * sends it again rather than losing it. Writers won't
+		 * touch bytes past the tail in the meantime.
+		 */
+		tail = kprintf_tail;
+		pos = tail % KPRINTF_BUFSIZE;
+		n = kprintf_head - tail;
+		if (n > KPRINTF_BUFSIZE - pos) {
+			n = KPRINTF_BUFSIZE - pos;
+		}
+		if (n > KPRINTF_CHUNK) {
+			n = KPRINTF_CHUNK;
+		}
+		kprintf_draining = true;
+		spinlock_release(&kprintf_buflock);
+
+		for (i=0; i<n; i++) {
+			putch(kprintf_buf[pos + i]);
+		}
+
+		spinlock_acquire(&kprintf_buflock);
+		kprintf_tail = tail + n;
+		lost = 0;
+		if (kprintf_head == kprintf_tail) {
+			lost = kprintf_lost;
+			kprintf_lost = 0;
+		}
+		spinlock_release(&kprintf_buflock);
+		if (lost > 0) {
+			/*
+			 * Not with kprintf: a writer waiting for space
+			 * could be holding kprintf_lock.
+			 */
+			n = snprintf(chunk, sizeof(chunk),
+				     "kprintf: buffer full, %u bytes lost\n",
+				     lost);
+			kprintf_append(chunk, n, false);
+		}
+	}
+}
+
+/*
+ * Send whatever is in the buffer, with interrupts off, for when the
+ * drain thread isn't going to get to run again. No locking; this is
+ * for panics, when other CPUs are stopped and we can't trust locks.
+ */
+static
+void
+kprintf_drain_polled(void)
+{
+	putch_prepare();
+	while (kprintf_tail != kprintf_head) {
+		putch(kprintf_buf[kprintf_tail % KPRINTF_BUFSIZE]);
+		kprintf_tail++;
+	}
+	putch_complete();
+}
+
+/*
+ * Start the drain thread and switch to buffered output.
+ */
+static
+void
+kprintf_async_bootstrap(void)
+{
+	int result;
+
+	spinlock_init(&kprintf_buflock);
+	kprintf_datawc = wchan_create("kprintf_data");
+	kprintf_spacewc = wchan_create("kprintf_space");
+	if (kprintf_datawc == NULL || kprintf_spacewc == NULL) {
+		panic("Could not create kprintf wait channels\n");
+	}
+
+	result = thread_fork("kprintf", NULL, kprintf_drain, NULL, 0);
+	if (result) {
+		panic("Could not start kprintf thread: %s\n",
+		      strerror(result));
+	}
+	kprintf_async = true;
+}
+#endif /* OPT_ASYNCPRINTF */
+
+/*
+ * Wait until everything kprintf'd so far has gone to the console.
+ * Does nothing if output isn't buffered, or if we can't sleep.
+ */
+void
+kprintf_flush(void)
+{
+#if OPT_ASYNCPRINTF
+	if (!kprintf_async || curthread->t_in_interrupt ||
+	    curthread->t_iplhigh_count > 0) {
+		return;
+	}
+	spinlock_acquire(&kprintf_buflock);
+	while (kprintf_head != kprintf_tail || kprintf_draining) {
+		wchan_lock(kprintf_spacewc);
+		spinlock_release(&kprintf_buflock);
+		wchan_sleep(kprintf_spacewc);
+		spinlock_acquire(&kprintf_buflock);
+	}
+	spinlock_release(&kprintf_buflock);
+#endif
+}
+
+/*
+ * Flush, and go back to printing synchronously. For shutdown.
+ */
+void
+kprintf_sync(void)
+{
+#if OPT_ASYNCPRINTF
+	kprintf_flush();
+	kprintf_async = false;
+#endif
+}
+
+/*
+ * Called from hardclock to wake the drain thread for output added
+ * where kprintf_append couldn't.
+ */
+void
+kprintf_wakeup(void)
+{
+#if OPT_ASYNCPRINTF
+	if (kprintf_async && kprintf_head != kprintf_tail) {
+		wchan_wakeone(kprintf_datawc);
+	}
+#endif
+}
+
 /*
  * Create the kprintf lock. Must be called before creating a second
  * thread or enabling a second CPU.
@@ -69,6 +343,10 @@ kprintf_bootstrap(void)
 		panic("Could not create kprintf_lock\n");
 	}
 	spinlock_init(&kprintf_spinlock);
+
+#if OPT_ASYNCPRINTF
+	kprintf_async_bootstrap();
+#endif
 }
 
 /*
@@ -96,11 +374,37 @@ kprintf(const char *fmt, ...)
 	int chars;
 	va_list ap;
 	bool dolock;
+#if OPT_ASYNCPRINTF
+	struct kprintf_chunk kc;
+#endif
 
 	dolock = kprintf_lock != NULL
 		&& curthread->t_in_interrupt == false
 		&& curthread->t_iplhigh_count == 0;
 
+#if OPT_ASYNCPRINTF
+	if (kprintf_async) {
+		/*
+		 * The lock keeps one thread's message from being split
+		 * up by another's; it's held only while formatting.
+		 * Interrupt handlers and the like just append.
+		 */
+		kc.kc_len = 0;
+		kc.kc_canwait = dolock;
+		if (dolock) {
+			lock_acquire(kprintf_lock);
+		}
+		va_start(ap, fmt);
+		chars = __vprintf(kprintf_chunk_send, &kc, fmt, ap);
+		va_end(ap);
+		kprintf_append(kc.kc_data, kc.kc_len, kc.kc_canwait);
+		if (dolock) {
+			lock_release(kprintf_lock);
+		}
+		return chars;
+	}
+#endif
+
 	if (dolock) {
 		lock_acquire(kprintf_lock);
 	}
@@ -169,6 +473,12 @@ panic(const char *fmt, ...)
 	if (evil == 2) {
 		evil = 3;
 
+#if OPT_ASYNCPRINTF
+		/* Get out what was buffered, and stop buffering */
+		kprintf_async = false;
+		kprintf_drain_polled();
+#endif
+
 		/* Print the message. */
 		kprintf("panic: ");
 		putch_prepare();
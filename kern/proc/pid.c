@@ -0,0 +1,82 @@
+/*
+ * Process ID table. See <pid.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <spinlock.h>
+#include <pid.h>
+
+static struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+static struct bitmap *pid_map;		/* allocated PIDs */
+static struct proc **pid_procs;		/* PID -> proc */
+static pid_t pid_next;			/* where to start looking */
+
+void
+pid_bootstrap(void)
+{
+	pid_t pid;
+
+	pid_map = bitmap_create(PID_MAX + 1);
+	pid_procs = kmalloc((PID_MAX + 1) * sizeof(struct proc *));
+	if (pid_map == NULL || pid_procs == NULL) {
+		panic("pid_bootstrap: Out of memory\n");
+	}
+	for (pid = 0; pid <= PID_MAX; pid++) {
+		pid_procs[pid] = NULL;
+	}
+	/* The numbers below PID_MIN are never handed out */
+	for (pid = 0; pid < PID_MIN; pid++) {
+		bitmap_mark(pid_map, pid);
+	}
+	pid_next = PID_MIN;
+}
+
+int
+pid_alloc(struct proc *proc, pid_t *ret)
+{
+	unsigned pid;
+
+	spinlock_acquire(&pid_lock);
+	if (bitmap_alloc_near(pid_map, pid_next, &pid)) {
+		spinlock_release(&pid_lock);
+		return ENPROC;
+	}
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+	KASSERT(pid_procs[pid] == NULL);
+	pid_procs[pid] = proc;
+	pid_next = (pid == PID_MAX) ? PID_MIN : pid + 1;
+	spinlock_release(&pid_lock);
+
+	*ret = pid;
+	return 0;
+}
+
+struct proc *
+pid_lookup(pid_t pid)
+{
+	struct proc *proc;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	spinlock_acquire(&pid_lock);
+	proc = pid_procs[pid];
+	spinlock_release(&pid_lock);
+	return proc;
+}
+
+void
+pid_free(pid_t pid)
+{
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+
+	spinlock_acquire(&pid_lock);
+	KASSERT(pid_procs[pid] != NULL);
+	pid_procs[pid] = NULL;
+	bitmap_unmark(pid_map, pid);
+	spinlock_release(&pid_lock);
+}
@@ -43,13 +43,20 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <file.h>
+#include <pid.h>
 #include <kern/fcntl.h>
+#include <kern/unistd.h>
+#include <kern/wait.h>
+#include <kmem_cache.h>
 #include "opt-A2.h"
 
 /*
@@ -70,14 +77,47 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem;
 
 #if OPT_A2
-static struct lock *cur_pid_lock;
-static volatile pid_t cur_pid;
-static bool kernel_initialized;
+/* protects parent/child links and exit status in all procs */
+static struct lock *proc_waitlock;
 #endif
 
 #endif  // UW
 
+/*
+ * Proc structures come from an object cache; a cached one keeps its
+ * thread array, spinlock, and wait CV.
+ */
+static struct kmem_cache *proc_cache;
+
+static
+int
+proc_ctor(void *obj)
+{
+	struct proc *proc = obj;
+
+#if OPT_A2
+	proc->p_waitcv = cv_create("p_waitcv");
+	if (proc->p_waitcv == NULL) {
+		return ENOMEM;
+	}
+#endif
+	threadarray_init(&proc->p_threads);
+	spinlock_init(&proc->p_lock);
+	return 0;
+}
 
+static
+void
+proc_dtor(void *obj)
+{
+	struct proc *proc = obj;
+
+	threadarray_cleanup(&proc->p_threads);
+	spinlock_cleanup(&proc->p_lock);
+#if OPT_A2
+	cv_destroy(proc->p_waitcv);
+#endif
+}
 
 /*
  * Create a proc structure.
@@ -86,24 +126,18 @@ static
 struct proc *
 proc_create(const char *name)
 {
-#if OPT_A2
-  KASSERT(cur_pid > 0);
-#endif
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 
-	threadarray_init(&proc->p_threads);
-	spinlock_init(&proc->p_lock);
-
 	/* VM fields */
 	proc->p_addrspace = NULL;
 
@@ -112,27 +146,37 @@ proc_create(const char *name)
   proc->tf = NULL;
 
 #if OPT_A2
-  if (kernel_initialized) {
-    lock_acquire(cur_pid_lock);
-      proc->pid = cur_pid;
-      cur_pid++;
-    lock_release(cur_pid_lock);
+  proc->parent = NULL;
+  proc->p_children = proc->p_zombies = NULL;
+  proc->p_nextsib = proc->p_prevsib = NULL;
+  proc->p_exited = false;
+  proc->p_exitstatus = 0;
+  proc->p_vfork = NULL;
+  ru_init(&proc->p_ru);
+  ru_init(&proc->p_ruchildren);
+  if (kproc == NULL) {
+    /* this is kproc; it isn't in the PID table */
+    proc->pid = PID_MIN - 1;
   }
-  else {
-    proc->pid = cur_pid;
-    cur_pid++;
+  else if (pid_alloc(proc, &proc->pid)) {
+    goto fail;
   }
-  proc->children_info = array_create();
-  proc->is_dying = cv_create("is_dying");
-  proc->child_lock = lock_create("child_lock");
-  proc->parent = NULL;
 #endif
 
-#ifdef UW
+#if OPT_A2
+	proc->p_fdtable = NULL;
+#elif defined(UW)
 	proc->console = NULL;
 #endif // UW
 
 	return proc;
+
+#if OPT_A2
+ fail:
+	kfree(proc->p_name);
+	kmem_cache_free(proc_cache, proc);
+	return NULL;
+#endif
 }
 
 /*
@@ -170,19 +214,15 @@ proc_destroy(struct proc *proc)
 	}
 
 #if OPT_A2
-  // destroy children_info array
-  lock_acquire(proc->child_lock);
-    for (int i = array_num(proc->children_info) - 1; i >= 0; i--) {
-      struct proc_info *pinfo = (struct proc_info *)array_get(proc->children_info, i);
-      pinfo->proc_addr->parent = NULL;
-      kfree(pinfo);
-      array_remove(proc->children_info, i);
-    }
-    array_destroy(proc->children_info);
-  lock_release(proc->child_lock);
-  // destroy is_dying cv and lock on children array
-  cv_destroy(proc->is_dying);
-  lock_destroy(proc->child_lock);
+  /*
+   * Take the PID out of the table under proc_waitlock, since
+   * proc_wait looks procs up and examines them while holding it.
+   */
+  lock_acquire(proc_waitlock);
+  KASSERT(proc->parent == NULL);
+  KASSERT(proc->p_children == NULL && proc->p_zombies == NULL);
+  pid_free(proc->pid);
+  lock_release(proc_waitlock);
 #endif
 
 #ifndef UW  // in the UW version, space destruction occurs in sys_exit, not here
@@ -205,17 +245,22 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-#ifdef UW
+#if OPT_A2
+	if (proc->p_fdtable) {
+		filetable_destroy(proc->p_fdtable);
+		proc->p_fdtable = NULL;
+	}
+#elif defined(UW)
 	if (proc->console) {
 	  vfs_close(proc->console);
 	}
 #endif // UW
 
-	threadarray_cleanup(&proc->p_threads);
-	spinlock_cleanup(&proc->p_lock);
+	/* p_threads and p_lock stay set up for the next user */
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
 
 	kfree(proc->p_name);
-	kfree(proc);
+	kmem_cache_free(proc_cache, proc);
 
 #ifdef UW
 	/* decrement the process count */
@@ -242,19 +287,22 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+  proc_cache = kmem_cache_create("proc", sizeof(struct proc),
+                                 proc_ctor, proc_dtor);
+  if (proc_cache == NULL) {
+    panic("could not create proc cache\n");
+  }
 #if OPT_A2
-  kernel_initialized = false;
-  cur_pid = 1;
-  cur_pid_lock = lock_create("cur_pid_lock");
-  if (cur_pid_lock == NULL) {
-    panic("could not create cur_pid_lock lock\n");
+  pid_bootstrap();
+  proc_waitlock = lock_create("proc_waitlock");
+  if (proc_waitlock == NULL) {
+    panic("could not create proc_waitlock lock\n");
   }
 #endif
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
   }
-  kernel_initialized = true;
 #ifdef UW
   proc_count = 0;
   proc_count_mutex = sem_create("proc_count_mutex",1);
@@ -268,6 +316,53 @@ proc_bootstrap(void)
 #endif // UW
 }
 
+#if OPT_A2
+/*
+ * Open the console on descriptor FD of a new process.
+ */
+static
+void
+proc_openconsole(struct filetable *ft, int fd, int openflags)
+{
+	struct openfile *of;
+	char *console_path;
+
+	/* this should always succeed */
+	console_path = kstrdup("con:");
+	if (console_path == NULL) {
+	  panic("unable to copy console path name during process creation\n");
+	}
+	if (openfile_open(console_path, openflags, 0, &of)) {
+	  panic("unable to open the console during process creation\n");
+	}
+	kfree(console_path);
+	filetable_placeat(ft, of, fd);
+}
+
+/*
+ * Give a new process its file descriptors: a copy of the current
+ * process's if it has any (this is how fork passes them on), and
+ * otherwise the console on stdin, stdout, and stderr.
+ */
+static
+int
+proc_setupfiles(struct proc *proc)
+{
+	if (curproc->p_fdtable != NULL) {
+		return filetable_copy(curproc->p_fdtable, &proc->p_fdtable);
+	}
+
+	proc->p_fdtable = filetable_create();
+	if (proc->p_fdtable == NULL) {
+		return ENOMEM;
+	}
+	proc_openconsole(proc->p_fdtable, STDIN_FILENO, O_RDONLY);
+	proc_openconsole(proc->p_fdtable, STDOUT_FILENO, O_WRONLY);
+	proc_openconsole(proc->p_fdtable, STDERR_FILENO, O_WRONLY);
+	return 0;
+}
+#endif /* OPT_A2 */
+
 /*
  * Create a fresh proc for use by runprogram.
  *
@@ -278,14 +373,18 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
+#if !OPT_A2
 	char *console_path;
+#endif
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
+#if OPT_A2
+	/* file descriptors are set up below, once proc_destroy is safe */
+#elif defined(UW)
 	/* open the console - this should always succeed */
 	console_path = kstrdup("con:");
 	if (console_path == NULL) {
@@ -329,6 +428,13 @@ proc_create_runprogram(const char *name)
 	V(proc_count_mutex);
 #endif // UW
 
+#if OPT_A2
+	if (proc_setupfiles(proc)) {
+		proc_destroy(proc);
+		return NULL;
+	}
+#endif
+
 	return proc;
 }
 
@@ -372,6 +478,10 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+#if OPT_A2
+			ru_add(&proc->p_ru, &t->t_ru);
+			ru_init(&t->t_ru);
+#endif
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -434,3 +544,165 @@ proc_setas(struct addrspace *newas, struct proc *proc)
 
   return oldas;
 }
+
+#if OPT_A2
+/*
+ * Parent/child lists. Each process is on its parent's p_children
+ * while it runs and on its parent's p_zombies once it has exited.
+ * Call with proc_waitlock held.
+ */
+static
+void
+proc_pushsib(struct proc **head, struct proc *p)
+{
+  p->p_prevsib = NULL;
+  p->p_nextsib = *head;
+  if (*head != NULL) {
+    (*head)->p_prevsib = p;
+  }
+  *head = p;
+}
+
+static
+void
+proc_unlinksib(struct proc **head, struct proc *p)
+{
+  if (p->p_prevsib != NULL) {
+    p->p_prevsib->p_nextsib = p->p_nextsib;
+  }
+  else {
+    KASSERT(*head == p);
+    *head = p->p_nextsib;
+  }
+  if (p->p_nextsib != NULL) {
+    p->p_nextsib->p_prevsib = p->p_prevsib;
+  }
+  p->p_nextsib = p->p_prevsib = NULL;
+}
+
+void
+proc_addchild(struct proc *parent, struct proc *child)
+{
+  lock_acquire(proc_waitlock);
+  KASSERT(child->parent == NULL);
+  child->parent = parent;
+  proc_pushsib(&parent->p_children, child);
+  lock_release(proc_waitlock);
+}
+
+bool
+proc_exited(struct proc *proc, int status)
+{
+  struct proc *child, *reap;
+  bool zombie;
+
+  lock_acquire(proc_waitlock);
+
+  /* Orphan the running children; they'll clean up after themselves */
+  while (proc->p_children != NULL) {
+    child = proc->p_children;
+    proc_unlinksib(&proc->p_children, child);
+    child->parent = NULL;
+  }
+  /* Nobody can wait for the exited ones now */
+  reap = proc->p_zombies;
+  proc->p_zombies = NULL;
+  for (child = reap; child != NULL; child = child->p_nextsib) {
+    child->parent = NULL;
+  }
+
+  proc->p_exitstatus = status;
+  proc->p_exited = true;
+  zombie = (proc->parent != NULL);
+  if (zombie) {
+    proc_unlinksib(&proc->parent->p_children, proc);
+    proc_pushsib(&proc->parent->p_zombies, proc);
+    cv_broadcast(proc->parent->p_waitcv, proc_waitlock);
+  }
+
+  lock_release(proc_waitlock);
+
+  while (reap != NULL) {
+    child = reap;
+    reap = child->p_nextsib;
+    child->p_nextsib = child->p_prevsib = NULL;
+    proc_destroy(child);
+  }
+  return zombie;
+}
+
+int
+proc_wait(pid_t pid, int options, pid_t *retpid, int *status,
+          struct ru_counts *ru)
+{
+  struct proc *child;
+
+  if ((options & ~WNOHANG) != 0) {
+    return EINVAL;
+  }
+  if (pid != WAIT_ANY && pid <= 0) {
+    /* no process groups */
+    return EINVAL;
+  }
+
+  lock_acquire(proc_waitlock);
+  while (1) {
+    if (pid == WAIT_ANY) {
+      child = curproc->p_zombies;
+      if (child == NULL && curproc->p_children == NULL) {
+        lock_release(proc_waitlock);
+        return ECHILD;
+      }
+    }
+    else {
+      child = pid_lookup(pid);
+      if (child == NULL) {
+        lock_release(proc_waitlock);
+        return ESRCH;
+      }
+      if (child->parent != curproc) {
+        lock_release(proc_waitlock);
+        return ECHILD;
+      }
+      if (!child->p_exited) {
+        child = NULL;
+      }
+    }
+    if (child != NULL) {
+      break;
+    }
+    if (options & WNOHANG) {
+      lock_release(proc_waitlock);
+      *retpid = 0;
+      return 0;
+    }
+    cv_wait(curproc->p_waitcv, proc_waitlock);
+  }
+
+  proc_unlinksib(&curproc->p_zombies, child);
+  child->parent = NULL;
+  *retpid = child->pid;
+  *status = child->p_exitstatus;
+  ru_add(&child->p_ru, &child->p_ruchildren);
+  ru_add(&curproc->p_ruchildren, &child->p_ru);
+  if (ru != NULL) {
+    *ru = child->p_ru;
+  }
+  lock_release(proc_waitlock);
+
+  proc_destroy(child);
+  return 0;
+}
+
+void
+proc_getrusage(struct ru_counts *ru)
+{
+  struct proc *proc = curproc;
+
+  spinlock_acquire(&proc->p_lock);
+  *ru = proc->p_ru;
+  spinlock_release(&proc->p_lock);
+  /* our own thread's counts haven't been folded in yet */
+  ru_add(ru, &curthread->t_ru);
+}
+#endif /* OPT_A2 */
@@ -0,0 +1,56 @@
+/*
+ * Resource usage accounting. See <rusage.h>.
+ */
+
+#include <types.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <clock.h>
+#include <rusage.h>
+
+void
+ru_init(struct ru_counts *ru)
+{
+	bzero(ru, sizeof(*ru));
+}
+
+void
+ru_add(struct ru_counts *to, const struct ru_counts *from)
+{
+	to->ru_uticks += from->ru_uticks;
+	to->ru_sticks += from->ru_sticks;
+	to->ru_nvcsw += from->ru_nvcsw;
+	to->ru_nivcsw += from->ru_nivcsw;
+	to->ru_tlbfaults += from->ru_tlbfaults;
+	to->ru_pagefaults += from->ru_pagefaults;
+	to->ru_inblock += from->ru_inblock;
+	to->ru_oublock += from->ru_oublock;
+}
+
+static
+void
+ru_ticks(uint32_t ticks, struct timeval *tv)
+{
+	tv->tv_sec = ticks / HZ;
+	tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/*
+ * TLB misses that we satisfy from memory count as minor faults; pages
+ * that had to be read in or zero-filled count as major ones.
+ */
+void
+ru_torusage(const struct ru_counts *ru, struct rusage *ret)
+{
+	bzero(ret, sizeof(*ret));
+	ru_ticks(ru->ru_uticks, &ret->ru_utime);
+	ru_ticks(ru->ru_sticks, &ret->ru_stime);
+	ret->ru_majflt = ru->ru_pagefaults;
+	ret->ru_minflt = ru->ru_tlbfaults > ru->ru_pagefaults ?
+		ru->ru_tlbfaults - ru->ru_pagefaults : 0;
+	ret->ru_inblock = ru->ru_inblock;
+	ret->ru_oublock = ru->ru_oublock;
+	ret->ru_nvcsw = ru->ru_nvcsw;
+	ret->ru_nivcsw = ru->ru_nivcsw;
+}
@@ -107,6 +107,7 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	synch_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
@@ -146,6 +147,7 @@ shutdown(void)
 {
 
 	kprintf("Shutting down.\n");
+	kprintf_sync();
 
 	vfs_clearbootfs();
 	vfs_clearcurdir();
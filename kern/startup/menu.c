@@ -42,9 +42,13 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <scstats.h>
+#include <ktrace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-scstats.h"
+#include "opt-ktrace.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -404,6 +408,83 @@ cmd_bootfs(int nargs, char **args)
 	return vfs_setbootfs(device);
 }
 
+static
+int
+cmd_iostat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vfs_iostat();
+
+	return 0;
+}
+
+#if OPT_SCSTATS
+static
+int
+cmd_scstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	scstats_print();
+
+	return 0;
+}
+#endif
+
+#if OPT_KTRACE
+/*
+ * Command for the event trace.
+ *    kt                 - decode the trace to the console
+ *    kt on [type ...]   - record the given types (default all)
+ *    kt off             - stop recording
+ *    kt clear           - discard what's been recorded
+ *    kt stream          - write the trace out through ltrace
+ */
+static
+int
+cmd_ktrace(int nargs, char **args)
+{
+	uint32_t mask;
+	int i, type;
+
+	if (nargs == 1) {
+		ktrace_print();
+	}
+	else if (!strcmp(args[1], "on")) {
+		mask = nargs == 2 ? (1U << KT_NTYPES) - 1 : 0;
+		for (i=2; i<nargs; i++) {
+			type = ktrace_typebyname(args[i]);
+			if (type < 0) {
+				kprintf("kt: Unknown event type %s\n", args[i]);
+				return EINVAL;
+			}
+			mask |= 1U << type;
+		}
+		ktrace_setmask(mask);
+	}
+	else if (!strcmp(args[1], "off")) {
+		ktrace_setmask(0);
+	}
+	else if (!strcmp(args[1], "clear")) {
+		ktrace_clear();
+	}
+	else if (!strcmp(args[1], "stream")) {
+		ktrace_stream();
+	}
+	else {
+		kprintf("Usage: kt [on [type ...] | off | clear | stream]\n");
+		kprintf("Types: switch wakeup fault syscall sysret "
+			"lockwait\n");
+		return EINVAL;
+	}
+
+	return 0;
+}
+#endif
+
 static
 int
 cmd_kheapstats(int nargs, char **args)
@@ -477,6 +558,9 @@ static const char *testmenu[] = {
 	"[bt]  Bitmap test                   ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
+	"[km3] Big kmalloc test              ",
+	"[km4] krealloc test                 ",
+	"[mb]  memcpy/bzero benchmark        ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -526,6 +610,13 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[io] Disk I/O stats                 ",
+#if OPT_SCSTATS
+	"[sc] System call stats              ",
+#endif
+#if OPT_KTRACE
+	"[kt] Kernel event trace             ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -583,12 +674,22 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "io",		cmd_iostat },
+#if OPT_SCSTATS
+	{ "sc",		cmd_scstats },
+#endif
+#if OPT_KTRACE
+	{ "kt",		cmd_ktrace },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
+	{ "km3",	mallocbig },
+	{ "km4",	mallocrealloc },
+	{ "mb",		membench },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
@@ -0,0 +1,175 @@
+/*
+ * Program argument staging. See <argbuf.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <argbuf.h>
+
+/* How many argv pointers to fetch from user space at once */
+#define ARGBUF_PTRBATCH		32
+
+int
+argbuf_init(struct argbuf *ab)
+{
+	ab->ab_data = kmalloc(ARG_MAX);
+	if (ab->ab_data == NULL) {
+		return ENOMEM;
+	}
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+	return 0;
+}
+
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	kfree(ab->ab_data);
+	ab->ab_data = NULL;
+}
+
+/*
+ * Room left for strings, keeping space for the argv array with one
+ * more entry and its NULL.
+ */
+static
+size_t
+argbuf_space(struct argbuf *ab)
+{
+	size_t used;
+
+	used = ab->ab_len + (ab->ab_argc + 2) * sizeof(userptr_t);
+	return used < ARG_MAX ? ARG_MAX - used : 0;
+}
+
+/*
+ * Copy in a user argv. The pointers are fetched in batches, but never
+ * past the end of the page the next one is on, so that we can't fault
+ * on memory beyond the array's NULL.
+ *
+ * Each batch's strings are then copied with one copyinstrs, limited
+ * as if all of them were going to be used, so that the space left for
+ * the argv array is always enough. If that limit is hit, the rest of
+ * the batch is done one string at a time against the exact limit.
+ */
+int
+argbuf_fromuser(struct argbuf *ab, const_userptr_t uargv)
+{
+	userptr_t ptrs[ARGBUF_PTRBATCH];
+	vaddr_t uaddr = (vaddr_t)uargv;
+	size_t n, i, done, got, space;
+	int result;
+
+	if (uaddr % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+
+	while (1) {
+		n = (PAGE_SIZE - (uaddr & ~PAGE_FRAME)) / sizeof(userptr_t);
+		if (n > ARGBUF_PTRBATCH) {
+			n = ARGBUF_PTRBATCH;
+		}
+		result = copyin((const_userptr_t)uaddr, ptrs,
+				n * sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
+		i = 0;
+		space = argbuf_space(ab);
+		if (space > (n - 1) * sizeof(userptr_t)) {
+			result = copyinstrs(ptrs, n, ab->ab_data + ab->ab_len,
+					    space - (n - 1) * sizeof(userptr_t),
+					    &done, &got);
+			ab->ab_len += got;
+			ab->ab_argc += done;
+			if (result && result != ENAMETOOLONG) {
+				return result;
+			}
+			if (result == 0 && done < n) {
+				/* stopped at the NULL */
+				return 0;
+			}
+			i = done;
+		}
+		for (; i<n; i++) {
+			if (ptrs[i] == NULL) {
+				return 0;
+			}
+			if (argbuf_space(ab) == 0) {
+				return E2BIG;
+			}
+			result = copyinstr(ptrs[i], ab->ab_data + ab->ab_len,
+					   argbuf_space(ab), &got);
+			if (result == ENAMETOOLONG) {
+				return E2BIG;
+			}
+			if (result) {
+				return result;
+			}
+			ab->ab_len += got;
+			ab->ab_argc++;
+		}
+		uaddr += n * sizeof(userptr_t);
+	}
+}
+
+/*
+ * Copy in a kernel argv (for runprogram).
+ */
+int
+argbuf_fromkernel(struct argbuf *ab, int argc, char **argv)
+{
+	size_t len;
+	int i;
+
+	for (i=0; i<argc; i++) {
+		len = strlen(argv[i]) + 1;
+		if (len > argbuf_space(ab)) {
+			return E2BIG;
+		}
+		memcpy(ab->ab_data + ab->ab_len, argv[i], len);
+		ab->ab_len += len;
+		ab->ab_argc++;
+	}
+	return 0;
+}
+
+/*
+ * Lay out argv and the strings below *STACKPTR, copy them out, and
+ * hand back the new stack pointer and the user address of argv.
+ */
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	size_t ptrsize, total, i;
+	vaddr_t base, str;
+	userptr_t *ptrs;
+	int result;
+
+	ptrsize = (ab->ab_argc + 1) * sizeof(userptr_t);
+	total = ptrsize + ab->ab_len;
+	KASSERT(total <= ARG_MAX);
+	base = (*stackptr - total) & ~(vaddr_t)7;
+
+	/* Make room for the pointers, then aim them at the strings */
+	memmove(ab->ab_data + ptrsize, ab->ab_data, ab->ab_len);
+	ptrs = (userptr_t *)ab->ab_data;
+	str = base + ptrsize;
+	for (i=0; i<(size_t)ab->ab_argc; i++) {
+		ptrs[i] = (userptr_t)str;
+		str += strlen(ab->ab_data + (str - base)) + 1;
+	}
+	ptrs[i] = NULL;
+
+	result = copyout(ab->ab_data, (userptr_t)base, total);
+	if (result) {
+		return result;
+	}
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return 0;
+}
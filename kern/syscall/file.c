@@ -0,0 +1,198 @@
+/*
+ * Open files and file descriptor tables. See <file.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <file.h>
+
+/*
+ * Make an openfile, with one reference, for a vnode that has already
+ * been opened.
+ */
+int
+openfile_create(struct vnode *vn, int openflags, struct openfile **ret)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	of->of_vnode = vn;
+	of->of_accmode = openflags & O_ACCMODE;
+	of->of_append = (openflags & O_APPEND) != 0;
+	of->of_offset = 0;
+	spinlock_init(&of->of_reflock);
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+/*
+ * Open a file and make an openfile for it.
+ */
+int
+openfile_open(char *path, int openflags, mode_t mode, struct openfile **ret)
+{
+	struct vnode *vn;
+	int result;
+
+	result = vfs_open(path, openflags, mode, &vn);
+	if (result) {
+		return result;
+	}
+	result = openfile_create(vn, openflags, ret);
+	if (result) {
+		vfs_close(vn);
+		return result;
+	}
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+/*
+ * Drop a reference; on the last one, close the file.
+ */
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_reflock);
+
+	if (!last) {
+		return;
+	}
+
+	vfs_close(of->of_vnode);
+	lock_destroy(of->of_lock);
+	spinlock_cleanup(&of->of_reflock);
+	kfree(of);
+}
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+int
+filetable_copy(struct filetable *src, struct filetable **ret)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		if (src->ft_files[i] != NULL) {
+			openfile_incref(src->ft_files[i]);
+			ft->ft_files[i] = src->ft_files[i];
+		}
+	}
+	*ret = ft;
+	return 0;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	unsigned i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+			ft->ft_files[i] = NULL;
+		}
+	}
+	kfree(ft);
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			*fd = i;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+int
+filetable_placeat(struct filetable *ft, struct openfile *of, int fd)
+{
+	struct openfile *old;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	old = ft->ft_files[fd];
+	ft->ft_files[fd] = of;
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+	return 0;
+}
+
+int
+filetable_remove(struct filetable *ft, int fd, struct openfile **ret)
+{
+	int result;
+
+	result = filetable_get(ft, fd, ret);
+	if (result) {
+		return result;
+	}
+	ft->ft_files[fd] = NULL;
+	return 0;
+}
@@ -8,6 +8,418 @@
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include "opt-A2.h"
+#if OPT_A2
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <limits.h>
+#include <stat.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <file.h>
+#include <pipe.h>
+#endif
+
+#if OPT_A2
+
+/*
+ * open() - copy in the path and open it at the lowest free descriptor.
+ */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
+  int fd, result;
+
+  DEBUG(DB_SYSCALL,"Syscall: open(%x,%d,%d)\n",(unsigned int)upath,flags,mode);
+
+  if ((flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
+  }
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(upath, path, PATH_MAX, NULL);
+  if (result) {
+    kfree(path);
+    return result;
+  }
+
+  /* openfile_open (vfs_open, really) mangles the path */
+  result = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (result) {
+    return result;
+  }
+
+  result = filetable_place(curproc->p_fdtable, of, &fd);
+  if (result) {
+    openfile_decref(of);
+    return result;
+  }
+
+  *retval = fd;
+  return 0;
+}
+
+/* iovec arrays up to this size are copied in on the stack */
+#define FILE_IOV_ONSTACK 8
+
+/*
+ * Common code for all the read and write calls: transfer between the
+ * IOVCNT user buffers in IOV and the file. If POS is negative, use and
+ * advance the file's seek position, holding its lock; otherwise do
+ * the I/O at POS and leave the seek position (and its lock) alone.
+ */
+static
+int
+file_io(int fdesc, struct iovec *iov, unsigned iovcnt, off_t pos,
+        enum uio_rw rw, int *retval)
+{
+  struct openfile *of;
+  struct uio u;
+  struct stat st;
+  size_t total;
+  unsigned i;
+  int result;
+
+  result = filetable_get(curproc->p_fdtable, fdesc, &of);
+  if (result) {
+    return result;
+  }
+  if (of->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+    return EBADF;
+  }
+
+  /* the total has to fit in the return value */
+  total = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > (size_t)0x7fffffff - total) {
+      return EINVAL;
+    }
+    total += iov[i].iov_len;
+  }
+
+  /* set up a uio structure to refer to the user program's buffers */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_resid = total;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+
+  if (pos >= 0) {
+    /* positional: the file must be seekable, but we don't touch of_offset */
+    result = VOP_TRYSEEK(of->of_vnode, pos);
+    if (result) {
+      return result;
+    }
+    u.uio_offset = pos;
+    result = (rw == UIO_READ) ? VOP_READ(of->of_vnode, &u) :
+                                VOP_WRITE(of->of_vnode, &u);
+    if (result) {
+      return result;
+    }
+  }
+  else {
+    lock_acquire(of->of_lock);
+
+    if (rw == UIO_WRITE && of->of_append) {
+      result = VOP_STAT(of->of_vnode, &st);
+      if (result) {
+        lock_release(of->of_lock);
+        return result;
+      }
+      of->of_offset = st.st_size;
+    }
+
+    u.uio_offset = of->of_offset;
+    result = (rw == UIO_READ) ? VOP_READ(of->of_vnode, &u) :
+                                VOP_WRITE(of->of_vnode, &u);
+    if (result) {
+      lock_release(of->of_lock);
+      return result;
+    }
+    of->of_offset = u.uio_offset;
+
+    lock_release(of->of_lock);
+  }
+
+  /* pass back the number of bytes actually transferred */
+  *retval = total - u.uio_resid;
+  KASSERT(*retval >= 0);
+  return 0;
+}
+
+/*
+ * Single-buffer read or write.
+ */
+static
+int
+file_rw(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos,
+        enum uio_rw rw, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_io(fdesc, &iov, 1, pos, rw, retval);
+}
+
+/*
+ * Vectored read or write: copy in the user's iovec array and go.
+ */
+static
+int
+file_rwv(int fdesc, const_userptr_t uiov, int iovcnt, off_t pos,
+         enum uio_rw rw, int *retval)
+{
+  struct iovec stackiov[FILE_IOV_ONSTACK];
+  struct iovec *iov;
+  int result;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+
+  if (iovcnt <= FILE_IOV_ONSTACK) {
+    iov = stackiov;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(struct iovec));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+  if (result == 0) {
+    result = file_io(fdesc, iov, iovcnt, pos, rw, retval);
+  }
+
+  if (iov != stackiov) {
+    kfree(iov);
+  }
+  return result;
+}
+
+int
+sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_rw(fdesc, ubuf, nbytes, -1, UIO_READ, retval);
+}
+
+int
+sys_write(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  return file_rw(fdesc, ubuf, nbytes, -1, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+          int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: pread(%d,%x,%d,%lld)\n",
+        fdesc,(unsigned int)ubuf,nbytes,pos);
+
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_rw(fdesc, ubuf, nbytes, pos, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int fdesc, userptr_t ubuf, unsigned int nbytes, off_t pos,
+           int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: pwrite(%d,%x,%d,%lld)\n",
+        fdesc,(unsigned int)ubuf,nbytes,pos);
+
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_rw(fdesc, ubuf, nbytes, pos, UIO_WRITE, retval);
+}
+
+int
+sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: readv(%d,%x,%d)\n",
+        fdesc,(unsigned int)uiov,iovcnt);
+
+  return file_rwv(fdesc, uiov, iovcnt, -1, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: writev(%d,%x,%d)\n",
+        fdesc,(unsigned int)uiov,iovcnt);
+
+  return file_rwv(fdesc, uiov, iovcnt, -1, UIO_WRITE, retval);
+}
+
+int
+sys_preadv(int fdesc, const_userptr_t uiov, int iovcnt, off_t pos,
+           int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: preadv(%d,%x,%d,%lld)\n",
+        fdesc,(unsigned int)uiov,iovcnt,pos);
+
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_rwv(fdesc, uiov, iovcnt, pos, UIO_READ, retval);
+}
+
+int
+sys_pwritev(int fdesc, const_userptr_t uiov, int iovcnt, off_t pos,
+            int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: pwritev(%d,%x,%d,%lld)\n",
+        fdesc,(unsigned int)uiov,iovcnt,pos);
+
+  if (pos < 0) {
+    return EINVAL;
+  }
+  return file_rwv(fdesc, uiov, iovcnt, pos, UIO_WRITE, retval);
+}
+
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: lseek(%d,%lld,%d)\n",fdesc,pos,whence);
+
+  result = filetable_get(curproc->p_fdtable, fdesc, &of);
+  if (result) {
+    return result;
+  }
+
+  lock_acquire(of->of_lock);
+
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    result = VOP_STAT(of->of_vnode, &st);
+    if (result) {
+      lock_release(of->of_lock);
+      return result;
+    }
+    newpos = st.st_size + pos;
+    break;
+  default:
+    lock_release(of->of_lock);
+    return EINVAL;
+  }
+
+  if (newpos < 0) {
+    lock_release(of->of_lock);
+    return EINVAL;
+  }
+  /* this also rejects seeking on the console and other char devices */
+  result = VOP_TRYSEEK(of->of_vnode, newpos);
+  if (result) {
+    lock_release(of->of_lock);
+    return result;
+  }
+  of->of_offset = newpos;
+
+  lock_release(of->of_lock);
+
+  *retval = newpos;
+  return 0;
+}
+
+/*
+ * pipe() - make a pipe and put its read and write ends in the lowest
+ * two free descriptors.
+ */
+int
+sys_pipe(userptr_t ufds)
+{
+  struct vnode *rv, *wv;
+  struct openfile *rof, *wof;
+  struct filetable *ft = curproc->p_fdtable;
+  int fds[2];
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: pipe(%x)\n",(unsigned int)ufds);
+
+  result = pipe_create(&rv, &wv);
+  if (result) {
+    return result;
+  }
+  result = openfile_create(rv, O_RDONLY, &rof);
+  if (result) {
+    vfs_close(rv);
+    vfs_close(wv);
+    return result;
+  }
+  result = openfile_create(wv, O_WRONLY, &wof);
+  if (result) {
+    openfile_decref(rof);
+    vfs_close(wv);
+    return result;
+  }
+
+  result = filetable_place(ft, rof, &fds[0]);
+  if (result) {
+    goto fail;
+  }
+  result = filetable_place(ft, wof, &fds[1]);
+  if (result) {
+    filetable_remove(ft, fds[0], &rof);
+    goto fail;
+  }
+
+  result = copyout(fds, ufds, sizeof(fds));
+  if (result) {
+    filetable_remove(ft, fds[0], &rof);
+    filetable_remove(ft, fds[1], &wof);
+    goto fail;
+  }
+  return 0;
+
+ fail:
+  openfile_decref(rof);
+  openfile_decref(wof);
+  return result;
+}
+
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: close(%d)\n",fdesc);
+
+  result = filetable_remove(curproc->p_fdtable, fdesc, &of);
+  if (result) {
+    return result;
+  }
+  openfile_decref(of);
+  return 0;
+}
+
+#else /* OPT_A2 */
 
 /* handler for write() system call                  */
 /*
@@ -58,3 +470,5 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+
+#endif /* OPT_A2 */
@@ -0,0 +1,104 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <syscall.h>
+#include <vnode.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <mmap.h>
+#include "opt-A2.h"
+#if OPT_A2
+#include <file.h>
+#endif
+
+#if OPT_A2
+
+/*
+ * mmap() - map a file, or anonymous memory, at an address of the
+ * kernel's choosing. The address hint is ignored.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fdesc,
+         off_t offset, int32_t *retval)
+{
+  struct addrspace *as;
+  struct openfile *of;
+  struct vnode *vn = NULL;
+  vaddr_t va;
+  int mode, result;
+
+  DEBUG(DB_SYSCALL,"Syscall: mmap(%x,%u,%d,%d,%d,%lld)\n",
+        (unsigned int)addr,len,prot,flags,fdesc,offset);
+  (void)addr;
+
+  mode = flags & (MAP_SHARED | MAP_PRIVATE);
+  if (mode != MAP_SHARED && mode != MAP_PRIVATE) {
+    return EINVAL;
+  }
+  if ((flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANON)) != 0 ||
+      (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0) {
+    return EINVAL;
+  }
+  if (len == 0 || offset < 0 || (offset & ~(off_t)PAGE_FRAME) != 0) {
+    return EINVAL;
+  }
+
+  as = curproc_getas();
+  KASSERT(as != NULL);
+
+  if ((flags & MAP_ANON) == 0) {
+    result = filetable_get(curproc->p_fdtable, fdesc, &of);
+    if (result) {
+      return result;
+    }
+    /* Faulting pages in reads the file; shared stores write it */
+    if (of->of_accmode == O_WRONLY) {
+      return EACCES;
+    }
+    if (mode == MAP_SHARED && (prot & PROT_WRITE) &&
+        of->of_accmode != O_RDWR) {
+      return EACCES;
+    }
+    vn = of->of_vnode;
+    result = VOP_MMAP(vn, prot);
+    if (result) {
+      return result;
+    }
+  }
+
+  result = mmap_create(as, len, prot, flags, vn, offset, &va);
+  if (result) {
+    return result;
+  }
+  *retval = (int32_t)va;
+  return 0;
+}
+
+/*
+ * munmap() - unmap a page-aligned range. Pieces of it that weren't
+ * mapped are ignored.
+ */
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+  vaddr_t va = (vaddr_t)addr;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: munmap(%x,%u)\n",(unsigned int)addr,len);
+
+  if ((va & ~(vaddr_t)PAGE_FRAME) != 0 || len == 0 ||
+      va >= USERSPACETOP || len > USERSPACETOP - va) {
+    return EINVAL;
+  }
+
+  result = mmap_remove(curproc_getas(), va, len);
+
+  /* Drop any translations for pages that are gone */
+  as_activate();
+  return result;
+}
+
+#endif /* OPT_A2 */
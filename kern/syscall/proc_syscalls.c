@@ -9,12 +9,34 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include "opt-A2.h"
 #if OPT_A2
+#include <synch.h>
 #include <mips/trapframe.h>
+#include <vnode.h>
 #include <vfs.h>
+#include <file.h>
+#include <argbuf.h>
+#include <limits.h>
 #include <kern/fcntl.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#endif
+
+#if OPT_A2
+/*
+ * A vfork child is done with its parent's address space: let the
+ * parent run again.
+ */
+static
+void
+vfork_release(struct proc *p)
+{
+  KASSERT(p->p_vfork != NULL);
+  V(p->p_vfork);
+  p->p_vfork = NULL;
+}
 #endif
-#include "opt-A2.h"
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
@@ -23,24 +45,6 @@ void sys__exit(int exitcode) {
 
   struct addrspace *as;
   struct proc *p = curproc;
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-#if OPT_A2
-  if (curproc->parent != NULL) {
-    lock_acquire(curproc->parent->child_lock);
-      for (unsigned int i = 0; i < array_num(curproc->parent->children_info); i++) {
-        struct proc_info *p_info = array_get(curproc->parent->children_info, i);
-        if (curproc->pid == p_info->pid) {
-          p_info->exit_code = exitcode;
-          break;
-        }
-      }
-    lock_release(curproc->parent->child_lock);
-    cv_signal(curproc->is_dying, curproc->child_lock);
-  }
-#else
-  (void)exitcode;
-#endif
 
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
@@ -54,15 +58,45 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
+#if OPT_A2
+  if (p->p_vfork != NULL) {
+    /* it's our parent's; give it back */
+    vfork_release(p);
+  }
+  else {
+    as_destroy(as);
+  }
+#else
   as_destroy(as);
+#endif
+
+#if OPT_A2
+  /* close files now, not when we're reaped, so e.g. pipe readers see EOF */
+  if (p->p_fdtable != NULL) {
+    filetable_destroy(p->p_fdtable);
+    p->p_fdtable = NULL;
+  }
+  if (p->p_cwd != NULL) {
+    VOP_DECREF(p->p_cwd);
+    p->p_cwd = NULL;
+  }
+#endif
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
   proc_remthread(curthread);
 
+#if OPT_A2
+  /* if our parent is around, it will destroy us when it reaps us */
+  if (!proc_exited(p, _MKWAIT_EXIT(exitcode))) {
+    proc_destroy(p);
+  }
+#else
+  (void)exitcode;
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
   proc_destroy(p);
+#endif
 
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
@@ -95,6 +129,11 @@ sys_waitpid(pid_t pid,
   int exitstatus;
   int result;
 
+#if OPT_A2
+  (void)exitstatus;
+  (void)result;
+  return sys_wait4(pid, status, options, NULL, retval);
+#else
   /* this is just a stub implementation that always reports an
      exit status of 0, regardless of the actual exit status of
      the specified process.
@@ -108,54 +147,82 @@ sys_waitpid(pid_t pid,
     return(EINVAL);
   }
   /* for now, just pretend the exitstatus is 0 */
-#if OPT_A2
-  lock_acquire(curproc->child_lock);
-    bool exists = false;
-    for (unsigned int i = 0; i < array_num(curproc->children_info); i++) {
-      struct proc_info * pinfo = array_get(curproc->children_info, i);
-      if (pid == pinfo->pid) {
-        exists = true;
-        struct proc_info *child = array_get(curproc->children_info, i);
-        while (child->exit_code == -1) {
-          cv_wait(child->proc_addr->is_dying, curproc->child_lock);
-        }
-        exitstatus = _MKWAIT_EXIT(child->exit_code);
-      }
-    }
-    if (!exists) {
-      lock_release(curproc->child_lock);
-      *retval = -1;
-      return (ESRCH);
-    }
-  lock_release(curproc->child_lock);
-#else
   exitstatus = 0;
-#endif
   result = copyout((void *)&exitstatus,status,sizeof(int));
   if (result) {
     return(result);
   }
   *retval = pid;
   return(0);
+#endif
 }
 
+#if OPT_A2
+/* waitpid() that also reports the child's resource usage */
+int
+sys_wait4(pid_t pid, userptr_t status, int options, userptr_t urusage,
+          pid_t *retval)
+{
+  struct ru_counts ru;
+  struct rusage kru;
+  int exitstatus;
+  int result;
+
+  result = proc_wait(pid, options, retval, &exitstatus, &ru);
+  if (result) {
+    return result;
+  }
+  if (*retval == 0) {
+    /* WNOHANG and nothing has exited */
+    return 0;
+  }
+  if (status != NULL) {
+    result = copyout((void *)&exitstatus,status,sizeof(int));
+    if (result) {
+      return result;
+    }
+  }
+  if (urusage != NULL) {
+    ru_torusage(&ru, &kru);
+    result = copyout(&kru, urusage, sizeof(kru));
+  }
+  return result;
+}
+
+int
+sys_getrusage(int who, userptr_t urusage)
+{
+  struct ru_counts ru;
+  struct rusage kru;
+
+  switch (who) {
+  case RUSAGE_SELF:
+    proc_getrusage(&ru);
+    break;
+  case RUSAGE_CHILDREN:
+    /* only the parent changes this, and we are the parent */
+    ru = curproc->p_ruchildren;
+    break;
+  default:
+    return EINVAL;
+  }
+  ru_torusage(&ru, &kru);
+  return copyout(&kru, urusage, sizeof(kru));
+}
+#endif
+
 int
 sys_fork(struct trapframe *tf, pid_t *retval)
 {
   // create child proc
   struct proc *child = proc_create_runprogram(curproc->p_name); // perhaps we want a diff name for child
-  KASSERT(child != NULL);
+  if (child == NULL) {
+    return ENPROC;
+  }
   KASSERT(child->pid > 0);
 
-  // set parent pointer
-  child->parent = curproc;
-
-  // add to children_info array
-  struct proc_info *child_info = kmalloc(sizeof(struct proc_info));
-  child_info->proc_addr = child;
-  child_info->exit_code = -1;
-  child_info->pid = child->pid;
-  array_add(curproc->children_info, child_info, NULL);
+  // link into our children, so we can wait for it
+  proc_addchild(curproc, child);
 
   // copy over address space
   int err = as_copy(curproc_getas(), &(child->p_addrspace));
@@ -177,125 +244,163 @@ sys_fork(struct trapframe *tf, pid_t *retval)
   return(0);
 }
 
-int sys_execv(const char * program_name, char ** args)
+#if OPT_A2
+static
+void
+vfork_child(void *tf, unsigned long unused)
 {
-	struct addrspace *as;
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
-	int result;
-  (void)args;
-
-  // copy over program name into kernel space
-  size_t program_name_size = (strlen(program_name) + 1) * sizeof(char);
-  char * program_name_kernel = kmalloc(program_name_size);
-  KASSERT(program_name_kernel != NULL);
-  int err = copyin((const_userptr_t) program_name, (void *) program_name_kernel, program_name_size);
-  KASSERT(err == 0);
-
-
-  // count number of args and copy into kernel
-  int num_args = 0;
-  for (int i = 0; args[i] != NULL; i++) {
-    num_args++;
-  }
+  (void)unused;
+  /* this copies the parent's trapframe, which stays put while we run */
+  enter_forked_process(tf);
+}
 
-  // copy program args into kernel
-  size_t args_array_size = (num_args + 1) * sizeof(char *);
-  char ** args_kernel = kmalloc(args_array_size);
-  KASSERT(args_kernel != NULL);
+/*
+ * vfork() - make a child that runs in our address space, instead of a
+ * copy of it, until it calls execv or _exit. We sleep until then, so
+ * the child has the address space (including our stack) to itself.
+ * This makes fork-and-exec cost about what the exec does.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *child;
+  struct semaphore *sem;
+  pid_t pid;
+  int status, result;
+
+  child = proc_create_runprogram(curproc->p_name);
+  if (child == NULL) {
+    return ENPROC;
+  }
+  sem = sem_create("vfork", 0);
+  if (sem == NULL) {
+    proc_destroy(child);
+    return ENOMEM;
+  }
+  child->p_vfork = sem;
+  proc_setas(curproc_getas(), child);
+  proc_addchild(curproc, child);
+  pid = child->pid;
 
-  for (int i = 0; i <= num_args; i++) {
-    if (i == num_args) {
-      args_kernel[i] = NULL;
-    }
-    else {
-      size_t arg_size = (strlen(args[i]) + 1) * sizeof(char);
-      args_kernel[i] = kmalloc(arg_size);
-      KASSERT(args_kernel[i] != NULL);
-      int err = copyin((const_userptr_t) args[i], (void *) args_kernel[i], arg_size);
-      KASSERT(err == 0);
+  result = thread_fork(child->p_name, child, vfork_child, tf, 0);
+  if (result) {
+    /* it never ran; reap it like an exited child */
+    child->p_vfork = NULL;
+    proc_setas(NULL, child);
+    sem_destroy(sem);
+    if (proc_exited(child, _MKWAIT_EXIT(0))) {
+      proc_wait(pid, 0, &pid, &status, NULL);
     }
+    return result;
   }
 
+  P(sem);
+  sem_destroy(sem);
 
-	/* Open the file. */
-	result = vfs_open(program_name_kernel, O_RDONLY, 0, &v);
-	if (result) {
-		return result;
-	}
-
-	/* We should be a new process. */
-	/* KASSERT(curproc_getas() == NULL); */
-
-	/* Create a new address space. */
-	as = as_create();
-	if (as ==NULL) {
-		vfs_close(v);
-		return ENOMEM;
-	}
-
-	/* Switch to it and activate it. */
-	struct addrspace * as_old = curproc_setas(as);
-	as_activate();
-
-	/* Load the executable. */
-	result = load_elf(v, &entrypoint);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-		return result;
-	}
-
-	/* Done with the file now. */
-	vfs_close(v);
-
-	/* Define the user stack in the address space */
-	result = as_define_stack(as, &stackptr);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		return result;
-	}
-
-  //HARD PART: COPY ARGS TO USER STACK
-  vaddr_t temp_stack_ptr = stackptr;
-  vaddr_t *stack_args = kmalloc((num_args + 1) * sizeof(vaddr_t));
-
-  for (int i = num_args; i >= 0; i--) {
-    if (i == num_args) {
-      stack_args[i] = (vaddr_t) NULL;
-      continue;
-    }
-    size_t arg_length = ROUNDUP(strlen(args_kernel[i]) + 1, 4);
-    size_t arg_size = arg_length * sizeof(char);
-    temp_stack_ptr -= arg_size;
-    int err = copyout((void *) args_kernel[i], (userptr_t) temp_stack_ptr, arg_length);
-    KASSERT(err == 0);
-    stack_args[i] = temp_stack_ptr;
+  *retval = pid;
+  return 0;
+}
+#endif /* OPT_A2 */
+
+/*
+ * execv() - replace our program. The path and arguments are copied in
+ * before anything is torn down, and the old address space is only
+ * destroyed once the new program is loaded and its arguments are in
+ * place, so a failed exec returns to the caller intact.
+ */
+int
+sys_execv(userptr_t uprogname, userptr_t uargv)
+{
+  struct addrspace *as, *oldas;
+  struct argbuf ab;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t argvptr;
+  char *progname;
+  int argc, result;
+
+  DEBUG(DB_SYSCALL,"Syscall: execv(%x,%x)\n",
+        (unsigned int)uprogname,(unsigned int)uargv);
+
+  progname = kmalloc(PATH_MAX);
+  if (progname == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(uprogname, progname, PATH_MAX, NULL);
+  if (result) {
+    kfree(progname);
+    return result;
+  }
+
+  result = argbuf_init(&ab);
+  if (result) {
+    kfree(progname);
+    return result;
+  }
+  result = argbuf_fromuser(&ab, uargv);
+  if (result) {
+    goto fail_args;
+  }
+
+  /* Open the file. */
+  result = vfs_open(progname, O_RDONLY, 0, &v);
+  if (result) {
+    goto fail_args;
   }
 
-  for (int i = num_args; i >= 0; i--) {
-    size_t str_pointer_size = sizeof(vaddr_t);
-    temp_stack_ptr -= str_pointer_size;
-    int err = copyout((void *) &stack_args[i], (userptr_t) temp_stack_ptr, str_pointer_size);
-    KASSERT(err == 0);
+  /* Create a new address space, and switch to it. */
+  as = as_create();
+  if (as == NULL) {
+    vfs_close(v);
+    result = ENOMEM;
+    goto fail_args;
   }
-  // HARD PART: COPY ARGS TO USER STACK
+  oldas = curproc_setas(as);
+  as_activate();
 
-  as_destroy(as_old);
-  kfree(program_name_kernel);
-  // might want to free args_kernel
-  for (int i = 0; i <= num_args; i++) {
-    kfree(args_kernel[i]);
+  /* Load the executable. */
+  result = load_elf(v, &entrypoint);
+  vfs_close(v);
+  if (result) {
+    goto fail_as;
   }
-  kfree(args_kernel);
 
-	/* Warp to user mode. */
-	enter_new_process(num_args /*argc*/, (userptr_t) temp_stack_ptr /*userspace addr of argv*/,
-			  ROUNDUP(temp_stack_ptr, 8), entrypoint);
+  /* Define the user stack, and put the arguments on it */
+  result = as_define_stack(as, &stackptr);
+  if (result) {
+    goto fail_as;
+  }
+  result = argbuf_copyout(&ab, &stackptr, &argvptr);
+  if (result) {
+    goto fail_as;
+  }
 
-	/* enter_new_process does not return. */
-	panic("enter_new_process returned\n");
+  /* No going back now. */
+  argc = ab.ab_argc;
+  argbuf_cleanup(&ab);
+  kfree(progname);
+  if (curproc->p_vfork != NULL) {
+    /* the old address space was borrowed from our parent */
+    vfork_release(curproc);
+  }
+  else {
+    as_destroy(oldas);
+  }
+
+  /* Warp to user mode. */
+  enter_new_process(argc, argvptr, stackptr, entrypoint);
+
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
   return EINVAL;
 
+ fail_as:
+  curproc_setas(oldas);
+  as_activate();
+  as_destroy(as);
+ fail_args:
+  argbuf_cleanup(&ab);
+  kfree(progname);
+  return result;
 }
 
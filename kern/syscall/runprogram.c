@@ -45,7 +45,7 @@
 #include <syscall.h>
 #include <test.h>
 #if OPT_A2
-#include <copyinout.h>
+#include <argbuf.h>
 #endif
 
 /*
@@ -83,7 +83,7 @@ runprogram(char *progname)
 	}
 
 	/* Switch to it and activate it. */
-	struct addrspace * as_old = curproc_setas(as);
+	curproc_setas(as);
 	as_activate();
 
 	/* Load the executable. */
@@ -104,34 +104,27 @@ runprogram(char *progname)
 		return result;
 	}
 #if OPT_A2
-  //HARD PART: COPY ARGS TO USER STACK
-  char ** args_kernel = args;
-  vaddr_t temp_stack_ptr = stackptr;
-  vaddr_t *stack_args = kmalloc((num_args + 1) * sizeof(vaddr_t));
+	{
+		struct argbuf ab;
+		userptr_t argvptr;
 
-  for (int i = num_args; i >= 0; i--) {
-    if (i == num_args) {
-      stack_args[i] = (vaddr_t) NULL;
-      continue;
-    }
-    size_t arg_length = ROUNDUP(strlen(args_kernel[i]) + 1, 4);
-    size_t arg_size = arg_length * sizeof(char);
-    temp_stack_ptr -= arg_size;
-    int err = copyout((void *) args_kernel[i], (userptr_t) temp_stack_ptr, arg_length);
-    KASSERT(err == 0);
-    stack_args[i] = temp_stack_ptr;
-  }
+		result = argbuf_init(&ab);
+		if (result) {
+			return result;
+		}
+		result = argbuf_fromkernel(&ab, num_args, args);
+		if (result == 0) {
+			result = argbuf_copyout(&ab, &stackptr, &argvptr);
+		}
+		argbuf_cleanup(&ab);
+		if (result) {
+			/* p_addrspace will go away when curproc is destroyed */
+			return result;
+		}
 
-  for (int i = num_args; i >= 0; i--) {
-    size_t str_pointer_size = sizeof(vaddr_t);
-    temp_stack_ptr -= str_pointer_size;
-    int err = copyout((void *) &stack_args[i], (userptr_t) temp_stack_ptr, str_pointer_size);
-    KASSERT(err == 0);
-  }
-  // HARD PART: COPY ARGS TO USER STACK
-	enter_new_process(num_args /*argc*/, (userptr_t) temp_stack_ptr /*userspace addr of argv*/,
-			  ROUNDUP(temp_stack_ptr, 8), entrypoint);
-  as_destroy(as_old);
+		/* Warp to user mode. */
+		enter_new_process(num_args, argvptr, stackptr, entrypoint);
+	}
 #else
 	/* Warp to user mode. */
 	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
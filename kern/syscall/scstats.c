@@ -0,0 +1,210 @@
+/*
+ * System call statistics. See <scstats.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <scstats.h>
+
+/* Names for the calls we implement; others print as numbers */
+static const char *const scstats_names[SCSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_wait4] = "wait4",
+	[SYS_getpid] = "getpid",
+	[SYS_getrusage] = "getrusage",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_preadv] = "preadv",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_pwritev] = "pwritev",
+	[SYS_lseek] = "lseek",
+	[SYS___time] = "__time",
+	[SYS_reboot] = "reboot",
+	[SYS___scstats] = "__scstats",
+};
+
+void
+scstats_cpuinit(struct cpu *c)
+{
+	c->c_scstats = kmalloc(SCSTAT_NCALLS * sizeof(struct scstat));
+	if (c->c_scstats == NULL) {
+		panic("scstats_cpuinit: Out of memory\n");
+	}
+	bzero(c->c_scstats, SCSTAT_NCALLS * sizeof(struct scstat));
+}
+
+void
+scstats_enter(int callno)
+{
+	int spl;
+
+	if (callno < 0 || callno >= SCSTAT_NCALLS) {
+		return;
+	}
+	spl = splhigh();
+	curcpu->c_scstats[callno].ss_calls++;
+	splx(spl);
+}
+
+void
+scstats_exit(int callno, int err, uint32_t cycles)
+{
+	struct scstat *ss;
+	unsigned b;
+	uint32_t val;
+	int spl;
+
+	if (callno < 0 || callno >= SCSTAT_NCALLS) {
+		return;
+	}
+
+	/* Bucket 0 is below 2^8; each one after that doubles */
+	b = 0;
+	for (val = cycles >> 8; val != 0 && b < SCSTAT_NLAT-1; val >>= 1) {
+		b++;
+	}
+
+	/*
+	 * We may have started the call on another CPU, but we charge
+	 * it to this one; all that matters is that only one CPU writes
+	 * each table.
+	 */
+	spl = splhigh();
+	ss = &curcpu->c_scstats[callno];
+	if (err) {
+		ss->ss_errors++;
+	}
+	ss->ss_cycles += cycles;
+	if (cycles > ss->ss_maxcycles) {
+		ss->ss_maxcycles = cycles;
+	}
+	ss->ss_lat[b]++;
+	splx(spl);
+}
+
+void
+scstats_get(struct scstat *ret, unsigned ncalls)
+{
+	struct scstat *ss;
+	struct cpu *c;
+	unsigned n, i, j;
+
+	KASSERT(ncalls <= SCSTAT_NCALLS);
+	bzero(ret, ncalls * sizeof(*ret));
+
+	for (n=0; (c = cpu_get(n)) != NULL; n++) {
+		for (i=0; i<ncalls; i++) {
+			ss = &c->c_scstats[i];
+			ret[i].ss_calls += ss->ss_calls;
+			ret[i].ss_errors += ss->ss_errors;
+			ret[i].ss_cycles += ss->ss_cycles;
+			if (ss->ss_maxcycles > ret[i].ss_maxcycles) {
+				ret[i].ss_maxcycles = ss->ss_maxcycles;
+			}
+			for (j=0; j<SCSTAT_NLAT; j++) {
+				ret[i].ss_lat[j] += ss->ss_lat[j];
+			}
+		}
+	}
+}
+
+void
+scstats_print(void)
+{
+	struct scstat *all, *ss;
+	uint64_t done;
+	unsigned i, j;
+
+	all = kmalloc(SCSTAT_NCALLS * sizeof(*all));
+	if (all == NULL) {
+		kprintf("scstats: Out of memory\n");
+		return;
+	}
+	scstats_get(all, SCSTAT_NCALLS);
+
+	kprintf("%-12s %10s %8s %10s %10s\n",
+		"syscall", "calls", "errors", "avg cyc", "max cyc");
+	for (i=0; i<SCSTAT_NCALLS; i++) {
+		ss = &all[i];
+		if (ss->ss_calls == 0) {
+			continue;
+		}
+		done = 0;
+		for (j=0; j<SCSTAT_NLAT; j++) {
+			done += ss->ss_lat[j];
+		}
+		if (scstats_names[i] != NULL) {
+			kprintf("%-12s", scstats_names[i]);
+		}
+		else {
+			kprintf("#%-11u", i);
+		}
+		kprintf(" %10llu %8llu %10llu %10u\n", ss->ss_calls,
+			ss->ss_errors, done ? ss->ss_cycles / done : 0,
+			ss->ss_maxcycles);
+
+		if (done == 0) {
+			continue;
+		}
+		kprintf("    latency:");
+		for (j=0; j<SCSTAT_NLAT; j++) {
+			if (ss->ss_lat[j] == 0) {
+				continue;
+			}
+			if (j == SCSTAT_NLAT-1) {
+				kprintf(" >=%u:%u", 128U << j, ss->ss_lat[j]);
+			}
+			else {
+				kprintf(" <%u:%u", 256U << j, ss->ss_lat[j]);
+			}
+		}
+		kprintf(" (cycles)\n");
+	}
+	kfree(all);
+}
+
+/*
+ * __scstats() - copy out the statistics for calls [0, NCALLS), or as
+ * many as there are. Returns how many were copied.
+ */
+int
+sys___scstats(userptr_t buf, unsigned ncalls, int *retval)
+{
+	struct scstat *all;
+	int result;
+
+	if (ncalls > SCSTAT_NCALLS) {
+		ncalls = SCSTAT_NCALLS;
+	}
+	all = kmalloc(SCSTAT_NCALLS * sizeof(*all));
+	if (all == NULL) {
+		return ENOMEM;
+	}
+	scstats_get(all, ncalls);
+	result = copyout(all, buf, ncalls * sizeof(*all));
+	kfree(all);
+	if (result) {
+		return result;
+	}
+	*retval = ncalls;
+	return 0;
+}
@@ -33,26 +33,31 @@
 #include <syscall.h>
 
 /*
- * Example system call: get the time of day.
+ * Example system call: get the time of day. Either pointer may be
+ * NULL; both results go out in one batch.
  */
 int
 sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 {
 	time_t seconds;
 	uint32_t nanoseconds;
-	int result;
+	struct copyreq reqs[2];
+	unsigned nreqs = 0;
 
 	gettime(&seconds, &nanoseconds);
 
-	result = copyout(&seconds, user_seconds_ptr, sizeof(time_t));
-	if (result) {
-		return result;
+	if (user_seconds_ptr != NULL) {
+		reqs[nreqs].cr_uaddr = user_seconds_ptr;
+		reqs[nreqs].cr_kaddr = &seconds;
+		reqs[nreqs].cr_len = sizeof(time_t);
+		nreqs++;
 	}
-
-	result = copyout(&nanoseconds, user_nanoseconds_ptr, sizeof(uint32_t));
-	if (result) {
-		return result;
+	if (user_nanoseconds_ptr != NULL) {
+		reqs[nreqs].cr_uaddr = user_nanoseconds_ptr;
+		reqs[nreqs].cr_kaddr = &nanoseconds;
+		reqs[nreqs].cr_len = sizeof(uint32_t);
+		nreqs++;
 	}
 
-	return 0;
+	return copyout_batch(reqs, nreqs);
 }
@@ -29,21 +29,126 @@
 
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
 #include <bitmap.h>
 #include <test.h>
 
 #define TESTSIZE 533
+#define RANGESIZE 13
+#define BENCHSIZE (256*1024)
 
+/*
+ * Print how long OPS operations took, from (S1, NS1) to now.
+ */
+static
+void
+bitmapbench_report(const char *what, unsigned ops, time_t s1, uint32_t ns1)
+{
+	time_t s2, rs;
+	uint32_t ns2, rns;
+	uint64_t total;
+
+	gettime(&s2, &ns2);
+	getinterval(s1, ns1, s2, ns2, &rs, &rns);
+	total = (uint64_t)rs * 1000000000 + rns;
+	kprintf("  %-28s %8u ops  %8llu ns/op\n", what, ops,
+		ops ? total / ops : 0);
+}
+
+/*
+ * Time the allocation functions on a map of NBITS bits: filling it
+ * from empty, refilling holes left by freeing half the bits at
+ * random, with and without hints, and allocating short runs.
+ */
+static
+void
+bitmapbench(unsigned nbits)
+{
+	struct bitmap *b;
+	time_t s1;
+	uint32_t ns1;
+	unsigned i, n, x;
+	int result;
+
+	kprintf("Timing bitmap of %u bits...\n", nbits);
+	b = bitmap_create(nbits);
+	if (b == NULL) {
+		kprintf("bitmaptest: Out of memory\n");
+		return;
+	}
+
+	gettime(&s1, &ns1);
+	for (n=0; bitmap_alloc(b, &x) == 0; n++) {
+		/* nothing */
+	}
+	bitmapbench_report("bitmap_alloc, filling", n, s1, ns1);
+	KASSERT(n == nbits);
+
+	for (i=0; i<nbits; i++) {
+		if (random() % 2) {
+			bitmap_unmark(b, i);
+		}
+	}
+	gettime(&s1, &ns1);
+	n = bitmap_nfree(b);
+	bitmapbench_report("bitmap_nfree", 1, s1, ns1);
+
+	gettime(&s1, &ns1);
+	for (i=0; i<n; i++) {
+		result = bitmap_alloc(b, &x);
+		KASSERT(result == 0);
+	}
+	bitmapbench_report("bitmap_alloc, holes", n, s1, ns1);
+	KASSERT(bitmap_nfree(b) == 0);
+
+	for (i=0; i<nbits; i++) {
+		if (random() % 2) {
+			bitmap_unmark(b, i);
+		}
+	}
+	n = bitmap_nfree(b);
+	gettime(&s1, &ns1);
+	for (i=0; i<n; i++) {
+		result = bitmap_alloc_near(b, random() % nbits, &x);
+		KASSERT(result == 0);
+	}
+	bitmapbench_report("bitmap_alloc_near, random", n, s1, ns1);
+	KASSERT(bitmap_nfree(b) == 0);
+
+	/* Free aligned runs of 16 here and there, then take 8 at a time */
+	for (i=0; i + 16 <= nbits; i += 16) {
+		if (random() % 4 == 0) {
+			bitmap_unmark_range(b, i, 16);
+		}
+	}
+	gettime(&s1, &ns1);
+	for (n=0; bitmap_alloc_range(b, 8, &x) == 0; n++) {
+		/* nothing */
+	}
+	bitmapbench_report("bitmap_alloc_range(8)", n, s1, ns1);
+	KASSERT(bitmap_nfree(b) == 0);
+
+	bitmap_destroy(b);
+}
+
+/*
+ * Usage: bt [nbits]
+ * Checks the bitmap functions, then times them on a map of NBITS
+ * bits (default 256K).
+ */
 int
 bitmaptest(int nargs, char **args)
 {
 	struct bitmap *b;
 	char data[TESTSIZE];
-	uint32_t x;
+	uint32_t x, y;
+	unsigned benchsize;
 	int i;
 
-	(void)nargs;
-	(void)args;
+	benchsize = BENCHSIZE;
+	if (nargs > 1) {
+		benchsize = atoi(args[1]);
+	}
 
 	kprintf("Starting bitmap test...\n");
 
@@ -100,6 +205,29 @@ bitmaptest(int nargs, char **args)
 		KASSERT(bitmap_isset(b, i));
 		KASSERT(data[i]==0);
 	}
+	KASSERT(bitmap_nfree(b) == 0);
+
+	/* Runs: free two holes, only the second big enough */
+	bitmap_unmark_range(b, 100, RANGESIZE - 1);
+	bitmap_unmark_range(b, 300, RANGESIZE + 2);
+	KASSERT(bitmap_nfree(b) == 2*RANGESIZE + 1);
+	KASSERT(bitmap_alloc_range(b, RANGESIZE, &x) == 0);
+	KASSERT(x == 300);
+	for (i=0; i<RANGESIZE; i++) {
+		KASSERT(bitmap_isset(b, x + i));
+	}
+	KASSERT(bitmap_alloc_range(b, RANGESIZE, &y) != 0);
+	KASSERT(bitmap_alloc_near(b, 200, &y) == 0);
+	KASSERT(y == 300 + RANGESIZE);
+	KASSERT(bitmap_alloc(b, &y) == 0);
+	KASSERT(y == 100);
+	KASSERT(bitmap_nfree(b) == RANGESIZE - 1);
+
+	bitmap_destroy(b);
+
+	if (benchsize > 0) {
+		bitmapbench(benchsize);
+	}
 
 	kprintf("Bitmap test complete\n");
 	return 0;
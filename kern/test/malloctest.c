@@ -35,6 +35,7 @@
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
+#include <vm.h>
 
 /*
  * Test kmalloc; allocate ITEMSIZE bytes NTRIES times, freeing
@@ -137,3 +138,203 @@ mallocstress(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * mallocbig allocates more subpage blocks than the heap used to be
+ * able to track (256 pages' worth, before the pageref table could
+ * grow), checks that none of them got scribbled on, and frees them.
+ * The blocks are kept on a list threaded through themselves.
+ */
+
+#define BIGITEMSIZE   1000	/* 1024-byte blocks, 4 per page */
+#define BIGPAGES       320	/* more than the old limit of 256 */
+
+struct bigitem {
+	struct bigitem *next;
+	unsigned num;
+	unsigned char fill[BIGITEMSIZE - 2*sizeof(unsigned)];
+};
+
+int
+mallocbig(int nargs, char **args)
+{
+	struct bigitem *list = NULL, *item;
+	unsigned nitems, got, n, i;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting big kmalloc test...\n");
+
+	nitems = BIGPAGES * (PAGE_SIZE / 1024);
+	for (n=0; n<nitems; n++) {
+		item = kmalloc(sizeof(*item));
+		if (item == NULL) {
+			break;
+		}
+		item->next = list;
+		item->num = n;
+		for (i=0; i<sizeof(item->fill); i++) {
+			item->fill[i] = n & 0xff;
+		}
+		list = item;
+	}
+	got = n;
+	kprintf("mallocbig: allocated %u blocks (about %u pages)\n",
+		got, got / (PAGE_SIZE / 1024));
+
+	while (list != NULL) {
+		item = list;
+		list = item->next;
+		n--;
+		if (item->num != n) {
+			kprintf("mallocbig: block %u has number %u\n",
+				n, item->num);
+			ok = false;
+		}
+		for (i=0; i<sizeof(item->fill); i++) {
+			if (item->fill[i] != (n & 0xff)) {
+				kprintf("mallocbig: block %u corrupted at "
+					"byte %u\n", n, i);
+				ok = false;
+				break;
+			}
+		}
+		kfree(item);
+	}
+
+	if (got < nitems) {
+		/* Not necessarily a bug: there may just not be enough RAM */
+		kprintf("mallocbig: ran out of memory after %u of %u "
+			"blocks\n", got, nitems);
+	}
+	if (!ok) {
+		kprintf("mallocbig: test failed\n");
+	}
+	kprintf("big kmalloc test done\n");
+	return 0;
+}
+
+/*
+ * mallocrealloc grows a buffer with krealloc from a few bytes to
+ * REALLOCMAX, checking each time that the old contents came along,
+ * and counts how often it didn't have to move. Then it walks another
+ * buffer through reallocsizes[], which straddle the largest subpage
+ * size. Last, it checks that pages from alloc_kvpages can be written
+ * and read back.
+ */
+
+#define REALLOCMAX   (64*1024)
+#define KVPAGES      8
+
+static const size_t reallocsizes[] = {
+	2000, 2048, 3000, 2048, 8192, 100,
+};
+
+/*
+ * Resize *BUF from *SIZE to NEWSIZE bytes, check the contents, and
+ * fill in any new bytes. Returns false to stop: if out of memory, or
+ * if the contents were lost, in which case *OK is cleared too.
+ */
+static
+bool
+reallocstep(unsigned char **buf, size_t *size, size_t newsize,
+	    unsigned *grows, unsigned *inplace, bool *ok)
+{
+	unsigned char *newbuf;
+	size_t i, keep;
+
+	newbuf = krealloc(*buf, *size, newsize);
+	if (newbuf == NULL) {
+		kprintf("mallocrealloc: out of memory at %u bytes\n",
+			newsize);
+		return false;
+	}
+	(*grows)++;
+	if (newbuf == *buf) {
+		(*inplace)++;
+	}
+	keep = *size < newsize ? *size : newsize;
+	for (i=0; i<keep; i++) {
+		if (newbuf[i] != (unsigned char)(i * 7)) {
+			kprintf("mallocrealloc: byte %u lost going "
+				"from %u to %u bytes\n", i, *size,
+				newsize);
+			*buf = newbuf;
+			*size = newsize;
+			*ok = false;
+			return false;
+		}
+	}
+	for (i=keep; i<newsize; i++) {
+		newbuf[i] = (unsigned char)(i * 7);
+	}
+	*buf = newbuf;
+	*size = newsize;
+	return true;
+}
+
+int
+mallocrealloc(int nargs, char **args)
+{
+	unsigned char *buf;
+	size_t size, newsize, i;
+	unsigned grows = 0, inplace = 0;
+	uint32_t *words;
+	vaddr_t kva;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting krealloc test...\n");
+
+	buf = NULL;
+	size = 0;
+	for (newsize = 16; newsize <= REALLOCMAX; newsize *= 2) {
+		if (!reallocstep(&buf, &size, newsize, &grows, &inplace,
+				 &ok)) {
+			break;
+		}
+	}
+	kfree(buf);
+
+	buf = NULL;
+	size = 0;
+	for (i=0; i<sizeof(reallocsizes)/sizeof(reallocsizes[0]); i++) {
+		if (!reallocstep(&buf, &size, reallocsizes[i], &grows,
+				 &inplace, &ok)) {
+			break;
+		}
+	}
+	kfree(buf);
+	kprintf("mallocrealloc: %u grows, %u in place\n", grows, inplace);
+
+	kva = alloc_kvpages(KVPAGES);
+	if (kva == 0) {
+		kprintf("mallocrealloc: no kernel virtual pages "
+			"(not supported, or out of memory)\n");
+	}
+	else {
+		words = (uint32_t *)kva;
+		for (i=0; i<KVPAGES * PAGE_SIZE / sizeof(*words); i++) {
+			words[i] = i ^ 0x5a5a5a5a;
+		}
+		for (i=0; i<KVPAGES * PAGE_SIZE / sizeof(*words); i++) {
+			if (words[i] != (i ^ 0x5a5a5a5a)) {
+				kprintf("mallocrealloc: kvpages word %u "
+					"wrong\n", i);
+				ok = false;
+				break;
+			}
+		}
+		free_kpages(kva);
+	}
+
+	if (!ok) {
+		kprintf("mallocrealloc: test failed\n");
+	}
+	kprintf("krealloc test done\n");
+	return 0;
+}
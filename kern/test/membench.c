@@ -0,0 +1,144 @@
+/*
+ * Benchmark for the kernel's memcpy, memmove, and bzero, which are
+ * shared with libc (see common/libc/string). The userlevel
+ * counterpart is testbin/membench.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <test.h>
+
+#define MAXSIZE  65536
+#define SLOP     64
+
+static const size_t membench_sizes[] = { 16, 64, 512, 4096, MAXSIZE };
+#define NSIZES (sizeof(membench_sizes) / sizeof(membench_sizes[0]))
+
+/* Source and destination offsets from a word boundary */
+static const struct {
+	const char *name;
+	unsigned srcoff, dstoff;
+} membench_aligns[] = {
+	{ "aligned", 0, 0 },
+	{ "both+1", 1, 1 },
+	{ "src+1", 1, 0 },
+	{ "dst+3", 0, 3 },
+};
+#define NALIGNS (sizeof(membench_aligns) / sizeof(membench_aligns[0]))
+
+enum membench_op { MB_BYTES, MB_MEMCPY, MB_MEMMOVE, MB_BZERO };
+static const char *const membench_opnames[] = {
+	"byte loop", "memcpy", "memmove", "bzero",
+};
+
+static
+void
+membench_byteloop(char *d, const char *s, size_t len)
+{
+	volatile char *vd = d;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		vd[i] = s[i];
+	}
+}
+
+/*
+ * Do TOTAL bytes' worth of OP in calls of SIZE bytes; return KB/s.
+ */
+static
+unsigned
+membench_run(enum membench_op op, char *srcbuf, char *dstbuf,
+	     size_t size, unsigned srcoff, unsigned dstoff, unsigned total)
+{
+	time_t s1, s2, rs;
+	uint32_t ns1, ns2, rns;
+	uint64_t us;
+	unsigned done;
+	char *src = srcbuf + srcoff;
+	char *dst = dstbuf + dstoff;
+
+	gettime(&s1, &ns1);
+	for (done = 0; done < total; done += size) {
+		switch (op) {
+		    case MB_BYTES:
+			membench_byteloop(dst, src, size);
+			break;
+		    case MB_MEMCPY:
+			memcpy(dst, src, size);
+			break;
+		    case MB_MEMMOVE:
+			/* overlapping, so it has to copy backwards */
+			memmove(srcbuf + dstoff + 8, src, size);
+			break;
+		    case MB_BZERO:
+			bzero(dst, size);
+			break;
+		}
+	}
+	gettime(&s2, &ns2);
+
+	getinterval(s1, ns1, s2, ns2, &rs, &rns);
+	us = (uint64_t)rs * 1000000 + rns / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	return (unsigned)((uint64_t)total * 1000000 / 1024 / us);
+}
+
+/*
+ * Usage: mb [kilobytes]
+ * Moves the given amount (default 256K) with each routine, in calls
+ * of several sizes and at several alignments, and prints KB/s.
+ */
+int
+membench(int nargs, char **args)
+{
+	char *srcbuf, *dstbuf;
+	unsigned total = 256 * 1024;
+	unsigned i, j, k;
+	enum membench_op op;
+
+	if (nargs > 1) {
+		total = atoi(args[1]) * 1024;
+	}
+
+	srcbuf = kmalloc(MAXSIZE + SLOP);
+	dstbuf = kmalloc(MAXSIZE + SLOP);
+	if (srcbuf == NULL || dstbuf == NULL) {
+		kfree(srcbuf);
+		kfree(dstbuf);
+		kprintf("membench: Out of memory\n");
+		return ENOMEM;
+	}
+	for (i=0; i<MAXSIZE + SLOP; i++) {
+		srcbuf[i] = (char)i;
+	}
+
+	kprintf("membench: %u KB per test, KB/s\n", total / 1024);
+	for (op = MB_BYTES; op <= MB_BZERO; op++) {
+		kprintf("\n%-10s", membench_opnames[op]);
+		for (k=0; k<NALIGNS; k++) {
+			kprintf(" %10s", membench_aligns[k].name);
+		}
+		kprintf("\n");
+		for (j=0; j<NSIZES; j++) {
+			kprintf("%10u", membench_sizes[j]);
+			for (k=0; k<NALIGNS; k++) {
+				kprintf(" %10u",
+					membench_run(op, srcbuf, dstbuf,
+						membench_sizes[j],
+						membench_aligns[k].srcoff,
+						membench_aligns[k].dstoff,
+						total));
+			}
+			kprintf("\n");
+		}
+	}
+
+	kfree(srcbuf);
+	kfree(dstbuf);
+	return 0;
+}
@@ -119,7 +119,15 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	if (curthread->t_intr_fromuser) {
+		RU_CHARGE(ru_uticks, 1);
+	}
+	else {
+		RU_CHARGE(ru_sticks, 1);
+	}
+
 	curcpu->c_hardclocks++;
+	kprintf_wakeup();
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
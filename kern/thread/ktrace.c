@@ -0,0 +1,355 @@
+/*
+ * Kernel event trace. See <ktrace.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <clock.h>
+#include <current.h>
+#include <thread.h>
+#include <vm.h>
+#include <lamebus/ltrace.h>
+#include <ktrace.h>
+
+/* Records per CPU; must be a power of 2 so the index can wrap */
+#define KTRACE_NEVENTS	1024
+
+/*
+ * Keep the compiler from moving ring accesses across the head update.
+ * System/161 CPUs see each other's stores in order, so this is enough.
+ */
+#define KTRACE_BARRIER()	__asm volatile("" : : : "memory")
+
+struct ktrace_ring {
+	volatile uint32_t kr_head;	/* records ever written */
+	volatile uint32_t kr_base;	/* kr_head as of the last clear */
+	struct ktrace_event kr_events[KTRACE_NEVENTS];
+};
+
+/* A reader's copy of one ring */
+struct ktrace_snap {
+	unsigned ks_cpu;
+	unsigned ks_pos;		/* next record to hand out */
+	unsigned ks_num;		/* records copied */
+	struct ktrace_event ks_events[KTRACE_NEVENTS];
+};
+
+volatile uint32_t ktrace_mask;
+
+static const char *const ktrace_names[KT_NTYPES] = {
+	[KT_SWITCH] = "switch",
+	[KT_WAKEUP] = "wakeup",
+	[KT_FAULT] = "fault",
+	[KT_SYSCALL] = "syscall",
+	[KT_SYSRET] = "sysret",
+	[KT_LOCKWAIT] = "lockwait",
+};
+
+void
+ktrace_cpuinit(struct cpu *c)
+{
+	c->c_ktrace = kmalloc(sizeof(struct ktrace_ring));
+	if (c->c_ktrace == NULL) {
+		panic("ktrace_cpuinit: Out of memory\n");
+	}
+	c->c_ktrace->kr_head = 0;
+	c->c_ktrace->kr_base = 0;
+}
+
+void
+ktrace_record(unsigned type, unsigned aux, uint32_t arg0, uint32_t arg1)
+{
+	struct ktrace_ring *kr;
+	struct ktrace_event *ke;
+	time_t sec;
+	uint32_t nsec;
+	int spl;
+
+	/*
+	 * With interrupts off nothing else can write this CPU's ring,
+	 * so filling in the slot and then bumping the head is safe
+	 * without a lock.
+	 */
+	spl = splhigh();
+	kr = curcpu->c_ktrace;
+	if (kr != NULL) {
+		gettime(&sec, &nsec);
+		ke = &kr->kr_events[kr->kr_head % KTRACE_NEVENTS];
+		ke->ke_sec = sec;
+		ke->ke_nsec = nsec;
+		ke->ke_type = type;
+		ke->ke_aux = aux;
+		ke->ke_arg0 = arg0;
+		ke->ke_arg1 = arg1;
+		KTRACE_BARRIER();
+		kr->kr_head++;
+	}
+	splx(spl);
+}
+
+void
+ktrace_setmask(uint32_t mask)
+{
+	ktrace_mask = mask;
+}
+
+int
+ktrace_typebyname(const char *name)
+{
+	int i;
+
+	for (i=0; i<KT_NTYPES; i++) {
+		if (!strcmp(name, ktrace_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Clearing just moves each ring's base up to its head, so it doesn't
+ * race with the writers.
+ */
+void
+ktrace_clear(void)
+{
+	struct cpu *c;
+	unsigned n;
+
+	for (n=0; (c = cpu_get(n)) != NULL; n++) {
+		c->c_ktrace->kr_base = c->c_ktrace->kr_head;
+	}
+}
+
+/*
+ * Copy a ring. Once the head has reached H, record H may be being
+ * written into the slot of record H - KTRACE_NEVENTS; so anything at
+ * or before that, as the head stands afterwards, may have been
+ * overwritten or torn while we were copying it. Skip it.
+ */
+static
+void
+ktrace_snapshot(struct ktrace_ring *kr, struct ktrace_snap *ks)
+{
+	uint32_t head, first, n, i;
+
+	head = kr->kr_head;
+	KTRACE_BARRIER();
+	n = head - kr->kr_base;
+	if (n > KTRACE_NEVENTS) {
+		n = KTRACE_NEVENTS;
+	}
+	first = head - n;
+	for (i=0; i<n; i++) {
+		ks->ks_events[i] = kr->kr_events[(first + i) % KTRACE_NEVENTS];
+	}
+	KTRACE_BARRIER();
+	head = kr->kr_head;
+
+	ks->ks_num = n;
+	ks->ks_pos = 0;
+	if (head - first >= KTRACE_NEVENTS) {
+		i = head - first - KTRACE_NEVENTS + 1;
+		ks->ks_pos = i < n ? i : n;
+	}
+}
+
+/*
+ * Snapshot every CPU's ring. Returns the number of CPUs, or 0 if out
+ * of memory.
+ */
+static
+unsigned
+ktrace_collect(struct ktrace_snap ***ret)
+{
+	struct ktrace_snap **snaps;
+	struct cpu *c;
+	unsigned ncpus, n;
+
+	for (ncpus=0; cpu_get(ncpus) != NULL; ncpus++);
+
+	snaps = kmalloc(ncpus * sizeof(*snaps));
+	if (snaps == NULL) {
+		return 0;
+	}
+	for (n=0; n<ncpus; n++) {
+		snaps[n] = kmalloc(sizeof(struct ktrace_snap));
+		if (snaps[n] == NULL) {
+			while (n > 0) {
+				kfree(snaps[--n]);
+			}
+			kfree(snaps);
+			return 0;
+		}
+	}
+
+	for (n=0; n<ncpus; n++) {
+		c = cpu_get(n);
+		snaps[n]->ks_cpu = c->c_number;
+		ktrace_snapshot(c->c_ktrace, snaps[n]);
+	}
+	*ret = snaps;
+	return ncpus;
+}
+
+static
+void
+ktrace_release(struct ktrace_snap **snaps, unsigned ncpus)
+{
+	unsigned n;
+
+	for (n=0; n<ncpus; n++) {
+		kfree(snaps[n]);
+	}
+	kfree(snaps);
+}
+
+/*
+ * Hand out the earliest remaining record across all the snapshots,
+ * or NULL when they're used up.
+ */
+static
+const struct ktrace_event *
+ktrace_next(struct ktrace_snap **snaps, unsigned ncpus, unsigned *cpu)
+{
+	const struct ktrace_event *ke, *best = NULL;
+	unsigned n, bestn = 0;
+
+	for (n=0; n<ncpus; n++) {
+		if (snaps[n]->ks_pos >= snaps[n]->ks_num) {
+			continue;
+		}
+		ke = &snaps[n]->ks_events[snaps[n]->ks_pos];
+		if (best == NULL || ke->ke_sec < best->ke_sec ||
+		    (ke->ke_sec == best->ke_sec &&
+		     ke->ke_nsec < best->ke_nsec)) {
+			best = ke;
+			bestn = n;
+		}
+	}
+	if (best != NULL) {
+		snaps[bestn]->ks_pos++;
+		*cpu = snaps[bestn]->ks_cpu;
+	}
+	return best;
+}
+
+static
+void
+ktrace_decode(const struct ktrace_event *ke)
+{
+	static const char *const states[] = {
+		"run", "ready", "sleep", "zombie",
+	};
+	static const char *const faults[] = {
+		[VM_FAULT_READ] = "read",
+		[VM_FAULT_WRITE] = "write",
+		[VM_FAULT_READONLY] = "readonly",
+	};
+
+	switch (ke->ke_type) {
+	    case KT_SWITCH:
+		kprintf("0x%x -> 0x%x (%s)", ke->ke_arg0, ke->ke_arg1,
+			ke->ke_aux < 4 ? states[ke->ke_aux] : "?");
+		break;
+	    case KT_WAKEUP:
+		kprintf("0x%x on cpu%u by 0x%x", ke->ke_arg0, ke->ke_aux,
+			ke->ke_arg1);
+		break;
+	    case KT_FAULT:
+		kprintf("%s 0x%x at pc 0x%x",
+			ke->ke_aux < 3 ? faults[ke->ke_aux] : "?",
+			ke->ke_arg0, ke->ke_arg1);
+		break;
+	    case KT_SYSCALL:
+		kprintf("#%u (0x%x, 0x%x)", ke->ke_aux, ke->ke_arg0,
+			ke->ke_arg1);
+		break;
+	    case KT_SYSRET:
+		kprintf("#%u error %u retval 0x%x", ke->ke_aux, ke->ke_arg0,
+			ke->ke_arg1);
+		break;
+	    case KT_LOCKWAIT:
+		kprintf("0x%x held by 0x%x", ke->ke_arg0, ke->ke_arg1);
+		break;
+	    default:
+		kprintf("%u 0x%x 0x%x", ke->ke_aux, ke->ke_arg0,
+			ke->ke_arg1);
+		break;
+	}
+}
+
+void
+ktrace_print(void)
+{
+	struct ktrace_snap **snaps;
+	const struct ktrace_event *ke;
+	unsigned ncpus, n, cpu, total;
+	bool first = true;
+	time_t s0 = 0, s;
+	uint32_t ns0 = 0, ns;
+
+	ncpus = ktrace_collect(&snaps);
+	if (ncpus == 0) {
+		kprintf("ktrace: Out of memory\n");
+		return;
+	}
+
+	total = 0;
+	for (n=0; n<ncpus; n++) {
+		total += snaps[n]->ks_num - snaps[n]->ks_pos;
+	}
+	kprintf("ktrace: %u events (mask 0x%x)\n", total, ktrace_mask);
+
+	while ((ke = ktrace_next(snaps, ncpus, &cpu)) != NULL) {
+		if (first) {
+			/* Times are shown from the first event */
+			s0 = ke->ke_sec;
+			ns0 = ke->ke_nsec;
+			first = false;
+		}
+		getinterval(s0, ns0, ke->ke_sec, ke->ke_nsec, &s, &ns);
+		kprintf("%4lu.%09u cpu%u %-8s ", (unsigned long)s, ns, cpu,
+			ke->ke_type < KT_NTYPES ?
+			ktrace_names[ke->ke_type] : "?");
+		ktrace_decode(ke);
+		kprintf("\n");
+	}
+
+	ktrace_release(snaps, ncpus);
+}
+
+void
+ktrace_stream(void)
+{
+	struct ktrace_snap **snaps;
+	const struct ktrace_event *ke;
+	unsigned ncpus, n, cpu, total;
+
+	ncpus = ktrace_collect(&snaps);
+	if (ncpus == 0) {
+		kprintf("ktrace: Out of memory\n");
+		return;
+	}
+
+	total = 0;
+	for (n=0; n<ncpus; n++) {
+		total += snaps[n]->ks_num - snaps[n]->ks_pos;
+	}
+
+	ltrace_debug(KTRACE_STREAM_MAGIC);
+	ltrace_debug(total);
+	while ((ke = ktrace_next(snaps, ncpus, &cpu)) != NULL) {
+		ltrace_debug((cpu << 24) | (ke->ke_type << 16) | ke->ke_aux);
+		ltrace_debug(ke->ke_sec);
+		ltrace_debug(ke->ke_nsec);
+		ltrace_debug(ke->ke_arg0);
+		ltrace_debug(ke->ke_arg1);
+	}
+	ltrace_debug(KTRACE_STREAM_END);
+
+	ktrace_release(snaps, ncpus);
+	kprintf("ktrace: streamed %u events\n", total);
+}
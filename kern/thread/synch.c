@@ -33,17 +33,54 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <kmem_cache.h>
+#include <ktrace.h>
+
+/*
+ * Semaphores, locks, and CVs come from object caches, so a freed one
+ * keeps its wait channel and spinlock for the next create. Only the
+ * name is per-use.
+ */
+static struct kmem_cache *sem_cache;
+static struct kmem_cache *lock_cache;
+static struct kmem_cache *cv_cache;
 
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
 
+static
+int
+sem_ctor(void *obj)
+{
+  struct semaphore *sem = obj;
+
+	sem->sem_wchan = wchan_create("sem");
+	if (sem->sem_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&sem->sem_lock);
+  return 0;
+}
+
+static
+void
+sem_dtor(void *obj)
+{
+  struct semaphore *sem = obj;
+
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&sem->sem_lock);
+	wchan_destroy(sem->sem_wchan);
+}
+
 struct semaphore *
 sem_create(const char *name, int initial_count)
 {
@@ -51,25 +88,18 @@ sem_create(const char *name, int initial_count)
 
   KASSERT(initial_count >= 0);
 
-  sem = kmalloc(sizeof(struct semaphore));
+  sem = kmem_cache_alloc(sem_cache);
   if (sem == NULL) {
     return NULL;
   }
 
   sem->sem_name = kstrdup(name);
   if (sem->sem_name == NULL) {
-    kfree(sem);
+    kmem_cache_free(sem_cache, sem);
     return NULL;
   }
 
-	sem->sem_wchan = wchan_create(sem->sem_name);
-	if (sem->sem_wchan == NULL) {
-		kfree(sem->sem_name);
-		kfree(sem);
-		return NULL;
-	}
-
-	spinlock_init(&sem->sem_lock);
+  wchan_setname(sem->sem_wchan, sem->sem_name);
   sem->sem_count = initial_count;
 
   return sem;
@@ -79,12 +109,11 @@ void
 sem_destroy(struct semaphore *sem)
 {
   KASSERT(sem != NULL);
+  KASSERT(wchan_isempty(sem->sem_wchan));
 
-	/* wchan_cleanup will assert if anyone's waiting on it */
-	spinlock_cleanup(&sem->sem_lock);
-	wchan_destroy(sem->sem_wchan);
+  wchan_setname(sem->sem_wchan, "sem");
   kfree(sem->sem_name);
-  kfree(sem);
+  kmem_cache_free(sem_cache, sem);
 }
 
 void
@@ -147,31 +176,47 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+static
+int
+lock_ctor(void *obj)
+{
+  struct lock *lock = obj;
+
+  lock->lk_wchan = wchan_create("lock");
+  if (lock->lk_wchan == NULL) {
+    return ENOMEM;
+  }
+  spinlock_init(&lock->lk_lock);
+  return 0;
+}
+
+static
+void
+lock_dtor(void *obj)
+{
+  struct lock *lock = obj;
+
+  spinlock_cleanup(&lock->lk_lock);
+  wchan_destroy(lock->lk_wchan);
+}
+
 struct lock *
 lock_create(const char *name)
 {
   struct lock *lock;
 
-  lock = kmalloc(sizeof(struct lock));
+  lock = kmem_cache_alloc(lock_cache);
   if (lock == NULL) {
     return NULL;
   }
 
   lock->lk_name = kstrdup(name);
   if (lock->lk_name == NULL) {
-    kfree(lock);
+    kmem_cache_free(lock_cache, lock);
     return NULL;
   }
 
-  // add stuff here as needed
-  lock->lk_wchan = wchan_create(lock->lk_name);
-  if (lock->lk_wchan == NULL) {
-    kfree(lock->lk_name);
-    kfree(lock);
-    return NULL;
-  }
-
-  spinlock_init(&lock->lk_lock);
+  wchan_setname(lock->lk_wchan, lock->lk_name);
   lock->held = false;
   lock->owner = NULL;
 
@@ -182,13 +227,12 @@ void
 lock_destroy(struct lock *lock)
 {
   KASSERT(lock != NULL);
+  KASSERT(wchan_isempty(lock->lk_wchan));
 
-  // add stuff here as needed
   lock->owner = NULL;
-  spinlock_cleanup(&lock->lk_lock);
-  wchan_destroy(lock->lk_wchan);
+  wchan_setname(lock->lk_wchan, "lock");
   kfree(lock->lk_name);
-  kfree(lock);
+  kmem_cache_free(lock_cache, lock);
 }
 
 void
@@ -201,6 +245,7 @@ lock_acquire(struct lock *lock)
 
   spinlock_acquire(&lock->lk_lock);
   while (lock->held) {
+    KTRACE(KT_LOCKWAIT, 0, lock, lock->owner);
     wchan_lock(lock->lk_wchan);
     spinlock_release(&lock->lk_lock);
     wchan_sleep(lock->lk_wchan);
@@ -242,30 +287,45 @@ lock_do_i_hold(struct lock *lock)
 // CV
 
 
+static
+int
+cv_ctor(void *obj)
+{
+  struct cv *cv = obj;
+
+  cv->cv_wchan = wchan_create("cv");
+  if (cv->cv_wchan == NULL) {
+    return ENOMEM;
+  }
+  return 0;
+}
+
+static
+void
+cv_dtor(void *obj)
+{
+  struct cv *cv = obj;
+
+  wchan_destroy(cv->cv_wchan);
+}
+
 struct cv *
 cv_create(const char *name)
 {
   struct cv *cv;
 
-  cv = kmalloc(sizeof(struct cv));
+  cv = kmem_cache_alloc(cv_cache);
   if (cv == NULL) {
     return NULL;
   }
 
   cv->cv_name = kstrdup(name);
   if (cv->cv_name==NULL) {
-    kfree(cv);
-    return NULL;
-  }
-
-  // add stuff here as needed
-  cv->cv_wchan = wchan_create(cv->cv_name);
-  if (cv->cv_wchan == NULL) {
-    kfree(cv->cv_name);
-    kfree(cv);
+    kmem_cache_free(cv_cache, cv);
     return NULL;
   }
 
+  wchan_setname(cv->cv_wchan, cv->cv_name);
   return cv;
 }
 
@@ -273,11 +333,11 @@ void
 cv_destroy(struct cv *cv)
 {
   KASSERT(cv != NULL);
+  KASSERT(wchan_isempty(cv->cv_wchan));
 
-  // add stuff here as needed
-  wchan_destroy(cv->cv_wchan);
+  wchan_setname(cv->cv_wchan, "cv");
   kfree(cv->cv_name);
-  kfree(cv);
+  kmem_cache_free(cv_cache, cv);
 }
 
 void
@@ -309,3 +369,24 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	/* (void)cv;    // suppress warning until code gets written */
 	(void)lock;  // suppress warning until code gets written
 }
+
+////////////////////////////////////////////////////////////
+//
+// Setup
+
+/*
+ * Create the object caches. Must run before the first sem_create,
+ * lock_create, or cv_create.
+ */
+void
+synch_bootstrap(void)
+{
+  sem_cache = kmem_cache_create("semaphore", sizeof(struct semaphore),
+                                sem_ctor, sem_dtor);
+  lock_cache = kmem_cache_create("lock", sizeof(struct lock),
+                                 lock_ctor, lock_dtor);
+  cv_cache = kmem_cache_create("cv", sizeof(struct cv), cv_ctor, cv_dtor);
+  if (sem_cache == NULL || lock_cache == NULL || cv_cache == NULL) {
+    panic("synch_bootstrap: Out of memory\n");
+  }
+}
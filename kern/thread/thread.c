@@ -50,6 +50,9 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <scstats.h>
+#include <ktrace.h>
+#include <kmem_cache.h>
 
 #include "opt-synchprobs.h"
 
@@ -69,6 +72,12 @@ DECLARRAY(cpu);
 DEFARRAY(cpu, /*no inline*/ );
 static struct cpuarray allcpus;
 
+/*
+ * Thread structures come from an object cache. A cached thread keeps
+ * its stack, so most thread_forks don't have to allocate one.
+ */
+static struct kmem_cache *thread_cache;
+
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
@@ -111,6 +120,52 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Object cache constructor and destructor for struct thread. The
+ * stack is allocated the first time the thread is used by something
+ * that needs one, and then stays with it.
+ */
+static
+int
+thread_ctor(void *obj)
+{
+	struct thread *thread = obj;
+
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_stack = NULL;
+	return 0;
+}
+
+static
+void
+thread_dtor(void *obj)
+{
+	struct thread *thread = obj;
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+	}
+}
+
+/*
+ * Give a thread a stack, if it doesn't already have one from a
+ * previous use, and set the guard bands.
+ */
+static
+int
+thread_getstack(struct thread *thread)
+{
+	if (thread->t_stack == NULL) {
+		thread->t_stack = kmalloc(STACK_SIZE);
+		if (thread->t_stack == NULL) {
+			return ENOMEM;
+		}
+	}
+	thread_checkstack_init(thread);
+	return 0;
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -123,14 +178,14 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(thread_cache);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		kmem_cache_free(thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -138,8 +193,6 @@ thread_create(const char *name)
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
@@ -149,6 +202,10 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Resource usage fields */
+	thread->t_intr_fromuser = false;
+	ru_init(&thread->t_ru);
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -180,6 +237,8 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_kmag = NULL;
+	kmalloc_cpuinit(c);
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -189,6 +248,13 @@ cpu_create(unsigned hardware_number)
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
 
+#if OPT_SCSTATS
+	scstats_cpuinit(c);
+#endif
+#if OPT_KTRACE
+	ktrace_cpuinit(c);
+#endif
+
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
@@ -210,15 +276,16 @@ cpu_create(unsigned hardware_number)
 		 * cpu. This means we're using the boot stack, which
 		 * can't be freed. (Exercise: what would it take to
 		 * make it possible to free the boot stack?)
+		 *
+		 * This is the first thread ever created, so it can't
+		 * have come out of the cache with a stack.
 		 */
-		/*c->c_curthread->t_stack = ... */
+		KASSERT(c->c_curthread->t_stack == NULL);
 	}
 	else {
-		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
-		if (c->c_curthread->t_stack == NULL) {
+		if (thread_getstack(c->c_curthread)) {
 			panic("cpu_create: couldn't allocate stack");
 		}
-		thread_checkstack_init(c->c_curthread);
 	}
 	c->c_curthread->t_cpu = c;
 
@@ -227,6 +294,15 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+struct cpu *
+cpu_get(unsigned n)
+{
+	if (n >= cpuarray_num(&allcpus)) {
+		return NULL;
+	}
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Destroy a thread.
  *
@@ -249,9 +325,6 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -259,7 +332,7 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	kmem_cache_free(thread_cache, thread);
 }
 
 /*
@@ -351,6 +424,12 @@ thread_bootstrap(void)
 
 	cpuarray_init(&allcpus);
 
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread),
+					 thread_ctor, thread_dtor);
+	if (thread_cache == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -449,6 +528,8 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	KTRACE(KT_WAKEUP, targetcpu->c_number, target, curthread);
+
 	isidle = targetcpu->c_isidle;
 	threadlist_addtail(&targetcpu->c_runqueue, target);
 	if (isidle) {
@@ -492,13 +573,12 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
+	/* Allocate a stack, unless it came with one */
+	result = thread_getstack(newthread);
+	if (result) {
 		thread_destroy(newthread);
-		return ENOMEM;
+		return result;
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -513,7 +593,7 @@ thread_fork(const char *name,
 	}
 	result = proc_addthread(proc, newthread);
 	if (result) {
-		/* thread_destroy will clean up the stack */
+		/* the stack stays with the thread in the cache */
 		thread_destroy(newthread);
 		return result;
 	}
@@ -612,6 +692,15 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	}
 	cur->t_state = newstate;
 
+	/* Yielding from an interrupt handler means hardclock preempted us */
+	if (newstate == S_SLEEP ||
+	    (newstate == S_READY && !cur->t_in_interrupt)) {
+		cur->t_ru.ru_nvcsw++;
+	}
+	else if (newstate == S_READY) {
+		cur->t_ru.ru_nivcsw++;
+	}
+
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
@@ -641,6 +730,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	KTRACE(KT_SWITCH, newstate, cur, next);
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -998,6 +1089,16 @@ wchan_destroy(struct wchan *wc)
 	kfree(wc);
 }
 
+/*
+ * Rename a wait channel. Must be empty.
+ */
+void
+wchan_setname(struct wchan *wc, const char *name)
+{
+	KASSERT(threadlist_isempty(&wc->wc_threads));
+	wc->wc_name = name;
+}
+
 /*
  * Lock and unlock a wait channel, respectively.
  */
@@ -36,8 +36,11 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <stat.h>
 #include <lib.h>
+#include <clock.h>
+#include <copyinout.h>
 #include <uio.h>
 #include <synch.h>
 #include <vnode.h>
@@ -124,13 +127,20 @@ dev_write(struct vnode *v, struct uio *uio)
 }
 
 /*
- * Called for ioctl(). Just pass through.
+ * Called for ioctl(). DIOCGSTAT is the same for every device, so we
+ * handle it here; pass everything else through.
  */
 static
 int
 dev_ioctl(struct vnode *v, int op, userptr_t data)
 {
 	struct device *d = v->vn_data;
+	struct devstat ds;
+
+	if (op == DIOCGSTAT) {
+		devstats_get(d, &ds);
+		return copyout(&ds, data, sizeof(ds));
+	}
 	return d->d_ioctl(d, op, data);
 }
 
@@ -241,15 +251,17 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. None of our devices make sense to map: the disks are
+ * accessed through the filesystems, and the rest are character
+ * devices.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, int prot)
 {
 	(void)v;
-	return EUNIMP;
+	(void)prot;
+	return ENODEV;
 }
 
 /*
@@ -463,3 +475,191 @@ dev_create_vnode(struct device *dev)
 
 	return v;
 }
+
+////////////////////////////////////////////////////////////
+// I/O statistics
+
+/*
+ * Current time, in nanoseconds.
+ */
+static
+uint64_t
+devstats_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Histogram bucket for a value: 0 if it is below 2^SHIFT, otherwise
+ * one more than the bucket for half the value, up to NBUCKETS-1.
+ */
+static
+unsigned
+devstats_bucket(uint64_t val, unsigned shift, unsigned nbuckets)
+{
+	unsigned b = 0;
+
+	val >>= shift;
+	while (val != 0 && b < nbuckets-1) {
+		val >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void
+devstats_init(struct device *dev)
+{
+	struct devstats *dst = &dev->d_stats;
+
+	spinlock_init(&dst->ds_lock);
+	bzero(&dst->ds_stat, sizeof(dst->ds_stat));
+	/* Devices may be attached before the clock; start at first use */
+	dst->ds_since = 0;
+}
+
+void
+devstats_queued(struct device *dev, struct devreq *req)
+{
+	struct devstats *dst = &dev->d_stats;
+
+	req->dr_qtime = devstats_now();
+	req->dr_stime = 0;
+
+	spinlock_acquire(&dst->ds_lock);
+	if (dst->ds_since == 0) {
+		dst->ds_since = req->dr_qtime;
+	}
+	dst->ds_stat.ds_qdepth++;
+	if (dst->ds_stat.ds_qdepth > dst->ds_stat.ds_maxqdepth) {
+		dst->ds_stat.ds_maxqdepth = dst->ds_stat.ds_qdepth;
+	}
+	spinlock_release(&dst->ds_lock);
+}
+
+void
+devstats_started(struct device *dev, struct devreq *req)
+{
+	(void)dev;
+	req->dr_stime = devstats_now();
+}
+
+void
+devstats_done(struct device *dev, struct devreq *req)
+{
+	struct devstats *dst = &dev->d_stats;
+	struct devstat *ds = &dst->ds_stat;
+	uint64_t now, lat;
+
+	now = devstats_now();
+	if (req->dr_stime == 0) {
+		/* Never got as far as the hardware */
+		req->dr_stime = now;
+	}
+	lat = now - req->dr_qtime;
+
+	spinlock_acquire(&dst->ds_lock);
+
+	KASSERT(ds->ds_qdepth > 0);
+	ds->ds_qdepth--;
+
+	if (req->dr_result) {
+		ds->ds_errors++;
+	}
+	if (req->dr_write) {
+		ds->ds_writes++;
+		ds->ds_wblocks += req->dr_xfered;
+	}
+	else {
+		ds->ds_reads++;
+		ds->ds_rblocks += req->dr_xfered;
+	}
+
+	ds->ds_waitns += req->dr_stime - req->dr_qtime;
+	ds->ds_busyns += now - req->dr_stime;
+	if (lat > ds->ds_maxns) {
+		ds->ds_maxns = lat;
+	}
+
+	/* see <kern/ioctl.h> for the bucket boundaries */
+	ds->ds_lat[devstats_bucket(lat / 1000, 4, DEVSTAT_NLAT)]++;
+	ds->ds_size[devstats_bucket(req->dr_nblocks, 1, DEVSTAT_NSIZE)]++;
+
+	spinlock_release(&dst->ds_lock);
+}
+
+void
+devstats_get(struct device *dev, struct devstat *ret)
+{
+	struct devstats *dst = &dev->d_stats;
+	uint64_t since;
+
+	spinlock_acquire(&dst->ds_lock);
+	*ret = dst->ds_stat;
+	since = dst->ds_since;
+	spinlock_release(&dst->ds_lock);
+
+	ret->ds_elapsedns = since == 0 ? 0 : devstats_now() - since;
+}
+
+void
+devstats_print(struct device *dev, const char *name)
+{
+	struct devstat ds;
+	uint64_t reqs, usecs, elapsedms;
+	unsigned i;
+
+	devstats_get(dev, &ds);
+
+	reqs = ds.ds_reads + ds.ds_writes;
+	elapsedms = ds.ds_elapsedns / 1000000;
+	if (elapsedms == 0) {
+		elapsedms = 1;
+	}
+
+	kprintf("%s: %llu reads (%llu blocks), %llu writes (%llu blocks), "
+		"%llu errors\n", name,
+		ds.ds_reads, ds.ds_rblocks, ds.ds_writes, ds.ds_wblocks,
+		ds.ds_errors);
+	kprintf("%s: queue depth %u now, %u max\n", name,
+		ds.ds_qdepth, ds.ds_maxqdepth);
+	kprintf("%s: throughput %llu bytes/s, busy %llu%%\n", name,
+		(ds.ds_rblocks + ds.ds_wblocks) * dev->d_blocksize
+			* 1000 / elapsedms,
+		ds.ds_busyns / 10000 / elapsedms);
+	if (reqs == 0) {
+		return;
+	}
+	kprintf("%s: avg wait %llu us, avg service %llu us, max %llu us\n",
+		name, ds.ds_waitns / reqs / 1000, ds.ds_busyns / reqs / 1000,
+		ds.ds_maxns / 1000);
+
+	kprintf("%s: latency:", name);
+	for (i=0; i<DEVSTAT_NLAT; i++) {
+		if (ds.ds_lat[i] == 0) {
+			continue;
+		}
+		usecs = (uint64_t)16 << i;
+		if (i == DEVSTAT_NLAT-1) {
+			kprintf(" >=%llu:%u", usecs / 2, ds.ds_lat[i]);
+		}
+		else {
+			kprintf(" <%llu:%u", usecs, ds.ds_lat[i]);
+		}
+	}
+	kprintf(" (us)\n");
+
+	kprintf("%s: size:", name);
+	for (i=0; i<DEVSTAT_NSIZE; i++) {
+		if (ds.ds_size[i] == 0) {
+			continue;
+		}
+		kprintf(" %s%u:%u", i == DEVSTAT_NSIZE-1 ? ">=" : "",
+			1U << i, ds.ds_size[i]);
+	}
+	kprintf(" (blocks)\n");
+}
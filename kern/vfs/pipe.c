@@ -0,0 +1,373 @@
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer with two vnodes on it, one for each end.
+ * Neither vnode belongs to a filesystem; they exist only as long as
+ * someone has them open.
+ *
+ * Data is moved with at most two uiomoves per chunk, one for each side
+ * of the wrap point, so a transfer is one copyin or copyout of each
+ * contiguous piece rather than a loop over bytes. The ring restarts
+ * at offset 0 whenever it empties, so a page-sized write into an idle
+ * pipe (and the read that drains it) is a single copy.
+ *
+ * Writes of up to PIPE_BUF bytes are atomic: the writer waits until
+ * there is room for all of it. Longer writes go in as space appears
+ * and may be interleaved with other writers.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <kern/stattypes.h>
+#include <limits.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/* Size of the ring buffer */
+#define PIPE_SIZE	(2 * PAGE_SIZE)
+
+struct pipe {
+	struct vnode pp_rvnode;		/* read end */
+	struct vnode pp_wvnode;		/* write end */
+
+	struct lock *pp_lock;		/* protects everything below */
+	unsigned pp_nvnodes;		/* ends not yet reclaimed */
+	struct cv *pp_readcv;		/* wait here for data */
+	struct cv *pp_writecv;		/* wait here for space */
+	char *pp_buf;			/* PIPE_SIZE bytes */
+	unsigned pp_head;		/* offset of first byte of data */
+	unsigned pp_count;		/* bytes of data */
+	bool pp_rclosed;		/* read end closed */
+	bool pp_wclosed;		/* write end closed */
+};
+
+/*
+ * Move N bytes between the ring and UIO: out of the ring from the
+ * head when reading, into it after the data when writing. If uiomove
+ * fails part way, the ring accounts for what did get moved.
+ */
+static
+int
+pipe_move(struct pipe *pp, struct uio *uio, unsigned n)
+{
+	unsigned start, chunk, done;
+	size_t before;
+	int result;
+
+	KASSERT(lock_do_i_hold(pp->pp_lock));
+
+	start = uio->uio_rw == UIO_READ ? pp->pp_head :
+		(pp->pp_head + pp->pp_count) % PIPE_SIZE;
+
+	before = uio->uio_resid;
+	chunk = n < PIPE_SIZE - start ? n : PIPE_SIZE - start;
+	result = uiomove(pp->pp_buf + start, chunk, uio);
+	if (result == 0 && chunk < n) {
+		result = uiomove(pp->pp_buf, n - chunk, uio);
+	}
+	done = before - uio->uio_resid;
+
+	if (uio->uio_rw == UIO_READ) {
+		pp->pp_head = (pp->pp_head + done) % PIPE_SIZE;
+		pp->pp_count -= done;
+		if (pp->pp_count == 0) {
+			pp->pp_head = 0;
+		}
+	}
+	else {
+		pp->pp_count += done;
+	}
+	return result;
+}
+
+/*
+ * Read: wait for some data (or for the writers to go away, which is
+ * EOF), then take as much as is there, up to what was asked for.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned n;
+	int result = 0;
+
+	if (v != &pp->pp_rvnode) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_count == 0 && !pp->pp_wclosed) {
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+	}
+
+	n = pp->pp_count < uio->uio_resid ? pp->pp_count : uio->uio_resid;
+	if (n > 0) {
+		result = pipe_move(pp, uio, n);
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	}
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Write: put everything in, waiting for space as needed. Fails with
+ * EPIPE if there are no readers left and nothing was written.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned space, want, n;
+	size_t total = uio->uio_resid;
+	int result;
+
+	if (v != &pp->pp_wvnode) {
+		return EBADF;
+	}
+
+	/* Small writes must go in all at once */
+	want = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		space = PIPE_SIZE - pp->pp_count;
+		if (pp->pp_rclosed) {
+			break;
+		}
+		if (space < want) {
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+
+		n = space < uio->uio_resid ? space : uio->uio_resid;
+		result = pipe_move(pp, uio, n);
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		if (result) {
+			lock_release(pp->pp_lock);
+			return result;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	if (uio->uio_resid == total && total > 0) {
+		return EPIPE;
+	}
+	return 0;
+}
+
+/*
+ * Last close of one end: tell the other end.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_rvnode) {
+		pp->pp_rclosed = true;
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	}
+	else {
+		pp->pp_wclosed = true;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	}
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+/*
+ * Last reference to one end gone; when both are, free the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned left;
+
+	VOP_CLEANUP(v);
+
+	/*
+	 * The two ends can be reclaimed at once on different CPUs, so
+	 * count under the lock; whoever takes it to zero frees the
+	 * pipe, and by then nobody else can be using the lock.
+	 */
+	lock_acquire(pp->pp_lock);
+	KASSERT(pp->pp_nvnodes > 0);
+	left = --pp->pp_nvnodes;
+	lock_release(pp->pp_lock);
+	if (left > 0) {
+		return 0;
+	}
+
+	kfree(pp->pp_buf);
+	cv_destroy(pp->pp_writecv);
+	cv_destroy(pp->pp_readcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+	return 0;
+}
+
+static
+int
+pipe_open(struct vnode *v, int openflags)
+{
+	(void)v;
+	(void)openflags;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = _S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(*statbuf));
+	statbuf->st_mode = _S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUF;
+	statbuf->st_size = pp->pp_count;	/* unlocked; just a hint */
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+/*
+ * Operations that make no sense on a pipe.
+ */
+
+static
+int
+pipe_notfile(void)
+{
+	return EINVAL;
+}
+
+static
+int
+pipe_notdir(void)
+{
+	return ENOTDIR;
+}
+
+/* The casts are the same trick sfs_vnode.c plays with sfs_notdir */
+#define NOTFILE ((void *)pipe_notfile)
+#define NOTDIR ((void *)pipe_notdir)
+
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	NOTFILE,	/* readlink */
+	NOTDIR,		/* getdirentry */
+	pipe_write,
+	NOTFILE,	/* ioctl */
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	NOTFILE,	/* mmap */
+	NOTFILE,	/* truncate */
+	NOTFILE,	/* namefile */
+	NOTDIR,		/* creat */
+	NOTDIR,		/* symlink */
+	NOTDIR,		/* mkdir */
+	NOTDIR,		/* link */
+	NOTDIR,		/* remove */
+	NOTDIR,		/* rmdir */
+	NOTDIR,		/* rename */
+	NOTDIR,		/* lookup */
+	NOTDIR,		/* lookparent */
+};
+
+/*
+ * Make a pipe. The two vnodes come back open, as if from vfs_open, so
+ * they should be released with vfs_close.
+ */
+int
+pipe_create(struct vnode **rret, struct vnode **wret)
+{
+	struct pipe *pp;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		goto fail_buf;
+	}
+	pp->pp_readcv = cv_create("pipe-read");
+	if (pp->pp_readcv == NULL) {
+		goto fail_lock;
+	}
+	pp->pp_writecv = cv_create("pipe-write");
+	if (pp->pp_writecv == NULL) {
+		goto fail_readcv;
+	}
+
+	pp->pp_head = pp->pp_count = 0;
+	pp->pp_rclosed = pp->pp_wclosed = false;
+	pp->pp_nvnodes = 2;
+
+	VOP_INIT(&pp->pp_rvnode, &pipe_vnode_ops, NULL, pp);
+	VOP_INIT(&pp->pp_wvnode, &pipe_vnode_ops, NULL, pp);
+	VOP_INCOPEN(&pp->pp_rvnode);
+	VOP_INCOPEN(&pp->pp_wvnode);
+
+	*rret = &pp->pp_rvnode;
+	*wret = &pp->pp_wvnode;
+	return 0;
+
+ fail_readcv:
+	cv_destroy(pp->pp_readcv);
+ fail_lock:
+	lock_destroy(pp->pp_lock);
+ fail_buf:
+	kfree(pp->pp_buf);
+	kfree(pp);
+	return ENOMEM;
+}
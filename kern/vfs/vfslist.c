@@ -421,6 +421,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	if (result == 0 && dev != NULL) {
 		/* use index+1 as the device number, so 0 is reserved */
 		dev->d_devnumber = index+1;
+		devstats_init(dev);
 	}
 
 	vfs_biglock_release();
@@ -593,6 +594,30 @@ vfs_unmount(const char *devname)
 	return result;
 }
 
+/*
+ * Print I/O statistics for every block device.
+ */
+void
+vfs_iostat(void)
+{
+	struct knowndev *kd;
+	unsigned i, num;
+
+	vfs_biglock_acquire();
+
+	num = knowndevarray_num(knowndevs);
+	for (i=0; i<num; i++) {
+		kd = knowndevarray_get(knowndevs, i);
+		if (kd->kd_device == NULL || kd->kd_device->d_blocks == 0) {
+			/* filesystem-device or character device */
+			continue;
+		}
+		devstats_print(kd->kd_device, kd->kd_name);
+	}
+
+	vfs_biglock_release();
+}
+
 /*
  * Global unmount function.
  */
@@ -214,6 +214,14 @@ copyout(const void *src, userptr_t userdest, size_t len)
 	return 0;
 }
 
+/*
+ * True if the word W has a zero byte in it. Subtracting one from each
+ * byte borrows out of the top bit of any byte that was zero (or of a
+ * byte above one that was); masking with ~W discards bytes whose top
+ * bit was already set.
+ */
+#define HASZEROBYTE(w)	((((w) - 0x01010101U) & ~(w) & 0x80808080U) != 0)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -235,9 +243,38 @@ int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
-
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	size_t i, lim;
+	uint32_t w;
+
+	lim = maxlen < stoplen ? maxlen : stoplen;
+
+	for (i=0; i<lim; i++) {
+		/*
+		 * Whenever the source is word-aligned, copy whole words
+		 * until we reach one with the null in it; that word is
+		 * then finished off a byte at a time below.
+		 */
+		if (((uintptr_t)(src + i) & 3) == 0) {
+			while (lim - i >= 4) {
+				w = *(const uint32_t *)(src + i);
+				if (HASZEROBYTE(w)) {
+					break;
+				}
+				if (((uintptr_t)(dest + i) & 3) == 0) {
+					*(uint32_t *)(dest + i) = w;
+				}
+				else {
+					dest[i] = src[i];
+					dest[i+1] = src[i+1];
+					dest[i+2] = src[i+2];
+					dest[i+3] = src[i+3];
+				}
+				i += 4;
+			}
+			if (i >= lim) {
+				break;
+			}
+		}
 		dest[i] = src[i];
 		if (src[i] == 0) {
 			if (gotlen != NULL) {
@@ -319,3 +356,112 @@ copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *actual)
 	curthread->t_machdep.tm_badfaultfunc = NULL;
 	return result;
 }
+
+/*
+ * copyin_batch, copyout_batch
+ *
+ * Do several copyins or copyouts with one setjmp, after checking all
+ * the ranges.
+ */
+static
+int
+copy_batch(const struct copyreq *reqs, unsigned nreqs, bool in)
+{
+	size_t stoplen;
+	unsigned i;
+	int result;
+
+	for (i=0; i<nreqs; i++) {
+		result = copycheck(reqs[i].cr_uaddr, reqs[i].cr_len, &stoplen);
+		if (result) {
+			return result;
+		}
+		if (stoplen != reqs[i].cr_len) {
+			return EFAULT;
+		}
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_machdep.tm_copyjmp);
+	if (result) {
+		curthread->t_machdep.tm_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<nreqs; i++) {
+		if (in) {
+			memcpy(reqs[i].cr_kaddr,
+			       (const void *)reqs[i].cr_uaddr,
+			       reqs[i].cr_len);
+		}
+		else {
+			memcpy((void *)reqs[i].cr_uaddr,
+			       reqs[i].cr_kaddr,
+			       reqs[i].cr_len);
+		}
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = NULL;
+	return 0;
+}
+
+int
+copyin_batch(const struct copyreq *reqs, unsigned nreqs)
+{
+	return copy_batch(reqs, nreqs, true);
+}
+
+int
+copyout_batch(const struct copyreq *reqs, unsigned nreqs)
+{
+	return copy_batch(reqs, nreqs, false);
+}
+
+/*
+ * copyinstrs
+ *
+ * Copy a batch of strings, packed end to end, with one setjmp. The
+ * counts are kept in volatile locals so they're still right after a
+ * longjmp back here.
+ */
+int
+copyinstrs(const userptr_t *uptrs, size_t n, char *dest, size_t len,
+	   size_t *nstrs, size_t *got)
+{
+	volatile size_t done = 0, used = 0;
+	size_t stoplen, thislen;
+	int result;
+
+	curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_machdep.tm_copyjmp);
+	if (result) {
+		result = EFAULT;
+		goto out;
+	}
+
+	for (; done < n && uptrs[done] != NULL; done++) {
+		if (used == len) {
+			result = ENAMETOOLONG;
+			goto out;
+		}
+		result = copycheck(uptrs[done], len - used, &stoplen);
+		if (result) {
+			goto out;
+		}
+		result = copystr(dest + used, (const char *)uptrs[done],
+				 len - used, stoplen, &thislen);
+		if (result) {
+			goto out;
+		}
+		used += thislen;
+	}
+	result = 0;
+
+ out:
+	curthread->t_machdep.tm_badfaultfunc = NULL;
+	*nstrs = done;
+	*got = used;
+	return result;
+}
@@ -29,8 +29,12 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
 #include <vm.h>
+#include <kmem_cache.h>
 
 /*
  * Kernel malloc.
@@ -118,51 +122,84 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * This is cheesy. 
- *
- * The problem is not that it's wasteful - we can only allocate whole
- * pages of pageref structures at a time anyway. The problem is that
- * we really ought to be able to have more than one of these pages.
- *
- * However, for the time being, one page worth of pagerefs gives us
- * 256 pagerefs; this lets us manage 256 * 4k = 1M of kernel heap.
- * That would be twice as much memory as we get for *everything*.
- * Thus, we will cheat and not allow any mechanism for having a second
- * page of pageref structs.
- *
- * Then, since the size is fixed at one page, we'll simplify a bit
- * further by allocating the page in the kernel BSS instead of calling
- * alloc_kpages to get it.
+ * Pagerefs are kept in pages of their own, each with a bitmap saying
+ * which of its pagerefs are in use. The first page is in the kernel
+ * BSS, so that the allocator works before anything else does; more
+ * are added with alloc_kpages as the heap grows, so the heap can use
+ * all of memory. Each page manages about 1M of heap, so we never give
+ * them back.
  */
 
-#define NPAGEREFS (PAGE_SIZE / sizeof(struct pageref))
-static struct pageref pagerefs[NPAGEREFS];
+#define NPAGEREFS ((PAGE_SIZE - 64) / sizeof(struct pageref))
+#define INUSE_WORDS ((NPAGEREFS + 31) / 32)
+
+struct pagerefpage {
+	struct pagerefpage *prp_next;
+	unsigned prp_nfree;
+	uint32_t prp_inuse[INUSE_WORDS];
+	struct pageref prp_refs[NPAGEREFS];
+};
+
+static struct pagerefpage pagerefs_first;
+static struct pagerefpage *pagerefpages;
+static unsigned pagerefs_total;
+
+static
+void
+initpagerefpage(struct pagerefpage *prp)
+{
+	unsigned i;
+
+	KASSERT(sizeof(*prp) <= PAGE_SIZE);
 
-#define INUSE_WORDS (NPAGEREFS/32)
-static uint32_t pagerefs_inuse[INUSE_WORDS];
+	for (i=0; i<INUSE_WORDS; i++) {
+		prp->prp_inuse[i] = 0;
+	}
+	prp->prp_nfree = NPAGEREFS;
+	prp->prp_next = pagerefpages;
+	pagerefpages = prp;
+	pagerefs_total += NPAGEREFS;
+}
 
 static
 struct pageref *
 allocpageref(void)
 {
+	struct pagerefpage *prp;
 	unsigned i,j;
 	uint32_t k;
 
-	for (i=0; i<INUSE_WORDS; i++) {
-		if (pagerefs_inuse[i]==0xffffffff) {
-			/* full */
+	if (pagerefpages == NULL) {
+		/* first call */
+		initpagerefpage(&pagerefs_first);
+	}
+
+	for (prp = pagerefpages; prp != NULL; prp = prp->prp_next) {
+		if (prp->prp_nfree == 0) {
 			continue;
 		}
-		for (k=1,j=0; k!=0; k<<=1,j++) {
-			if ((pagerefs_inuse[i] & k)==0) {
-				pagerefs_inuse[i] |= k;
-				return &pagerefs[i*32 + j];
+		for (i=0; i<INUSE_WORDS; i++) {
+			if (prp->prp_inuse[i]==0xffffffff) {
+				/* full */
+				continue;
+			}
+			for (k=1,j=0; k!=0; k<<=1,j++) {
+				if ((prp->prp_inuse[i] & k)==0) {
+					break;
+				}
+			}
+			if (i*32 + j >= NPAGEREFS) {
+				/* free bits past the end of the last word */
+				break;
 			}
+			prp->prp_inuse[i] |= k;
+			prp->prp_nfree--;
+			return &prp->prp_refs[i*32 + j];
 		}
 		KASSERT(0);
 	}
 
-	/* ran out */
+	/* ran out; caller adds another page */
 	return NULL;
 }
 
@@ -170,15 +207,23 @@ static
 void
 freepageref(struct pageref *p)
 {
+	struct pagerefpage *prp;
 	size_t i, j;
 	uint32_t k;
 
-	j = p-pagerefs;
-	KASSERT(j < NPAGEREFS);  /* note: j is unsigned, don't test < 0 */
+	for (prp = pagerefpages; prp != NULL; prp = prp->prp_next) {
+		if (p >= prp->prp_refs && p < prp->prp_refs + NPAGEREFS) {
+			break;
+		}
+	}
+	KASSERT(prp != NULL);
+
+	j = p-prp->prp_refs;
 	i = j/32;
 	k = ((uint32_t)1) << (j%32);
-	KASSERT((pagerefs_inuse[i] & k) != 0);
-	pagerefs_inuse[i] &= ~k;
+	KASSERT((prp->prp_inuse[i] & k) != 0);
+	prp->prp_inuse[i] &= ~k;
+	prp->prp_nfree++;
 }
 
 ////////////////////////////////////////
@@ -189,10 +234,8 @@ static struct pageref *allbase;
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the whole subpage allocator. Most calls don't
+ * get this far; they are satisfied from the per-cpu magazines below.
  */
 
 static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
@@ -260,14 +303,14 @@ checksubpages(void)
 	for (i=0; i<NSIZES; i++) {
 		for (pr = sizebases[i]; pr != NULL; pr = pr->next_samesize) {
 			checksubpage(pr);
-			KASSERT(sc < NPAGEREFS);
+			KASSERT(sc < pagerefs_total);
 			sc++;
 		}
 	}
 
 	for (pr = allbase; pr != NULL; pr = pr->next_all) {
 		checksubpage(pr);
-		KASSERT(ac < NPAGEREFS);
+		KASSERT(ac < pagerefs_total);
 		ac++;
 	}
 
@@ -330,6 +373,8 @@ dumpsubpage(struct pageref *pr)
 	kprintf("\n");
 }
 
+static void kmag_printstats(void);
+
 void
 kheap_printstats(void)
 {
@@ -345,6 +390,9 @@ kheap_printstats(void)
 	}
 
 	spinlock_release(&kmalloc_spinlock);
+
+	kmag_printstats();
+	kmem_cache_printstats();
 }
 
 ////////////////////////////////////////
@@ -399,6 +447,7 @@ subpage_kmalloc(size_t sz)
 	unsigned blktype;	// index into sizes[] that we're using
 	struct pageref *pr;	// pageref for page we're allocating from
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t prrefpage;	// new page of pagerefs, if needed
 	vaddr_t fla;		// free list entry address
 	struct freelist *volatile fl;	// free list entry
 	void *retptr;		// our result
@@ -470,15 +519,28 @@ subpage_kmalloc(size_t sz)
 
 	pr = allocpageref();
 	if (pr==NULL) {
-		/* Couldn't allocate accounting space for the new page. */
+		/*
+		 * Need another page of pagerefs. As above, get it
+		 * without the lock; someone else may have added one
+		 * meanwhile, but an extra one does no harm.
+		 */
 		spinlock_release(&kmalloc_spinlock);
-		free_kpages(prpage);
-		kprintf("kmalloc: Subpage allocator couldn't get pageref\n"); 
-		return NULL;
+		prrefpage = alloc_kpages(1);
+		if (prrefpage==0) {
+			free_kpages(prpage);
+			kprintf("kmalloc: Subpage allocator couldn't "
+				"get pageref\n"); 
+			return NULL;
+		}
+		spinlock_acquire(&kmalloc_spinlock);
+		initpagerefpage((struct pagerefpage *)prrefpage);
+		pr = allocpageref();
+		KASSERT(pr != NULL);
 	}
 
 	pr->pageaddr_and_blocktype = MKPAB(prpage, blktype);
 	pr->nfree = PAGE_SIZE / sizes[blktype];
+	kpage_settag(prpage, pr);
 
 	/*
 	 * Note: fl is volatile because the MIPS toolchain we were
@@ -508,6 +570,63 @@ subpage_kmalloc(size_t sz)
 	goto doalloc;
 }
 
+/*
+ * Find the pageref for the page PTRADDR is on, or NULL if it isn't a
+ * subpage block. Pages the VM system tracks carry their pageref as
+ * their kpage tag; only pages allocated before it started tracking
+ * need to be searched for, which requires kmalloc_spinlock.
+ */
+static
+struct pageref *
+subpage_search(vaddr_t ptraddr)
+{
+	struct pageref *pr;
+	vaddr_t prpage;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	for (pr = allbase; pr; pr = pr->next_all) {
+		prpage = PR_PAGEADDR(pr);
+
+		/* check for corruption */
+		KASSERT(PR_BLOCKTYPE(pr) < NSIZES);
+		checksubpage(pr);
+
+		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
+			return pr;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find the block type of PTR if it is a subpage block, or return -1.
+ * Normally this takes no lock: the tag of a page with live blocks on
+ * it doesn't change. Subpage blocks all live in kseg0, so anything in
+ * kseg2 (from alloc_kvpages) is ruled out without searching.
+ */
+static
+int
+subpage_blocktype(void *ptr)
+{
+	vaddr_t ptraddr = (vaddr_t)ptr;
+	struct pageref *pr;
+	void *tag;
+
+	if (ptraddr >= MIPS_KSEG2) {
+		return -1;
+	}
+	if (kpage_gettag(ptraddr & PAGE_FRAME, &tag)) {
+		pr = tag;
+	}
+	else {
+		spinlock_acquire(&kmalloc_spinlock);
+		pr = subpage_search(ptraddr);
+		spinlock_release(&kmalloc_spinlock);
+	}
+	return pr == NULL ? -1 : (int)PR_BLOCKTYPE(pr);
+}
+
 static
 int
 subpage_kfree(void *ptr)
@@ -519,6 +638,7 @@ subpage_kfree(void *ptr)
 	vaddr_t fla;		// free list entry address
 	struct freelist *fl;	// free list entry
 	vaddr_t offset;		// offset into page
+	void *tag;		// kpage tag of the page
 
 	ptraddr = (vaddr_t)ptr;
 
@@ -526,17 +646,11 @@ subpage_kfree(void *ptr)
 
 	checksubpages();
 
-	for (pr = allbase; pr; pr = pr->next_all) {
-		prpage = PR_PAGEADDR(pr);
-		blktype = PR_BLOCKTYPE(pr);
-
-		/* check for corruption */
-		KASSERT(blktype>=0 && blktype<NSIZES);
-		checksubpage(pr);
-
-		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
-			break;
-		}
+	if (kpage_gettag(ptraddr & PAGE_FRAME, &tag)) {
+		pr = tag;
+	}
+	else {
+		pr = subpage_search(ptraddr);
 	}
 
 	if (pr==NULL) {
@@ -545,6 +659,9 @@ subpage_kfree(void *ptr)
 		return -1;
 	}
 
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
+	checksubpage(pr);
 	offset = ptraddr - prpage;
 
 	/* Check for proper positioning and alignment */
@@ -578,6 +695,7 @@ subpage_kfree(void *ptr)
 		/* Whole page is free. */
 		remove_lists(pr, blktype);
 		freepageref(pr);
+		kpage_settag(prpage, NULL);
 		/* Call free_kpages without kmalloc_spinlock. */
 		spinlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
@@ -598,16 +716,364 @@ subpage_kfree(void *ptr)
 //
 ////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////
+//
+// Per-cpu magazines.
+//
+// In front of the subpage allocator, each cpu keeps two magazines
+// for each block size: small stacks of free blocks. kmalloc pops a
+// block off the loaded magazine and kfree pushes one on, with
+// interrupts off but no lock. When the loaded magazine runs empty (or
+// full) it is swapped with the previous one, and only when both are
+// empty (or full) do we go to the depot, a global stock of full and
+// empty magazines, to trade one in. So a cpu takes the depot lock at
+// most about once per KMAG_ROUNDS operations, and the subpage
+// allocator's lock only when the depot has nothing for it either.
+//
+// This is the scheme from Bonwick and Adams, "Magazines and Vmem"
+// (USENIX 2001).
+//
+// Blocks sitting in magazines are allocated as far as the subpage
+// allocator is concerned, so the pages they're on can't be given
+// back. To keep that bounded, the depot holds at most KMAG_DEPOT_FULL
+// full magazines per size; past that, kfree empties a full magazine
+// straight back into the subpage allocator. If we run out of pages,
+// the depot is emptied too and we try again.
+//
+
+/* Blocks per magazine; chosen so a struct kmag fills a 128-byte block */
+#define KMAG_ROUNDS 30
+
+/* Full magazines the depot keeps per size */
+#define KMAG_DEPOT_FULL 2
+
+struct kmag {
+	struct kmag *km_next;		/* depot list */
+	unsigned km_rounds;		/* blocks held */
+	void *km_blocks[KMAG_ROUNDS];
+};
+
+/* Per-cpu state; only touched by its own cpu, with interrupts off */
+struct kmag_cpu {
+	struct kmag *kc_loaded[NSIZES];	/* allocate from/free to this */
+	struct kmag *kc_prev[NSIZES];	/* the one before, full or empty */
+};
+
+struct kmag_depot {
+	struct kmag *kd_full;
+	struct kmag *kd_empty;
+	unsigned kd_nfull;
+	unsigned kd_nempty;
+};
+
+static struct kmag_depot kmag_depot[NSIZES];
+static struct spinlock kmag_depotlock = SPINLOCK_INITIALIZER;
+
+/*
+ * Get the current cpu's magazines, or NULL if we're too early in boot
+ * to have any. Call with interrupts off, so we stay on this cpu.
+ */
+static
+struct kmag_cpu *
+kmag_mycpu(void)
+{
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+	return curcpu->c_kmag;
+}
+
+/*
+ * Take a block of type BLKTYPE from this cpu's magazines, trading in
+ * an empty magazine for a full one at the depot if need be. Returns
+ * NULL if there are none to be had.
+ */
+static
+void *
+kmag_alloc(unsigned blktype)
+{
+	struct kmag_cpu *kc;
+	struct kmag_depot *kd;
+	struct kmag *mag;
+	void *ptr = NULL;
+	int spl;
+
+	spl = splhigh();
+	kc = kmag_mycpu();
+	if (kc == NULL) {
+		splx(spl);
+		return NULL;
+	}
+
+	mag = kc->kc_loaded[blktype];
+	if (mag == NULL || mag->km_rounds == 0) {
+		mag = kc->kc_prev[blktype];
+		if (mag != NULL && mag->km_rounds > 0) {
+			kc->kc_prev[blktype] = kc->kc_loaded[blktype];
+			kc->kc_loaded[blktype] = mag;
+		}
+		else {
+			/* Both empty: swap one for a full one */
+			kd = &kmag_depot[blktype];
+			spinlock_acquire(&kmag_depotlock);
+			mag = kd->kd_full;
+			if (mag != NULL) {
+				kd->kd_full = mag->km_next;
+				kd->kd_nfull--;
+				if (kc->kc_prev[blktype] != NULL) {
+					kc->kc_prev[blktype]->km_next =
+						kd->kd_empty;
+					kd->kd_empty = kc->kc_prev[blktype];
+					kd->kd_nempty++;
+				}
+				kc->kc_prev[blktype] = kc->kc_loaded[blktype];
+				kc->kc_loaded[blktype] = mag;
+			}
+			spinlock_release(&kmag_depotlock);
+		}
+	}
+
+	if (mag != NULL && mag->km_rounds > 0) {
+		mag->km_rounds--;
+		ptr = mag->km_blocks[mag->km_rounds];
+	}
+	splx(spl);
+	return ptr;
+}
+
+/*
+ * Give the blocks in MAG back to the subpage allocator.
+ */
+static
+void
+kmag_spill(struct kmag *mag)
+{
+	unsigned i;
+
+	for (i=0; i<mag->km_rounds; i++) {
+		if (subpage_kfree(mag->km_blocks[i])) {
+			panic("kmag_spill: stray block %p\n",
+			      mag->km_blocks[i]);
+		}
+	}
+	mag->km_rounds = 0;
+}
+
+/*
+ * Put a free block of type BLKTYPE in this cpu's magazines, trading in
+ * a full magazine for an empty one at the depot if need be. Returns
+ * false if there was no room.
+ */
+static
+bool
+kmag_free(void *ptr, unsigned blktype)
+{
+	struct kmag_cpu *kc;
+	struct kmag_depot *kd;
+	struct kmag *mag;
+	bool done = false;
+	int spl;
+
+	spl = splhigh();
+	kc = kmag_mycpu();
+	if (kc == NULL) {
+		splx(spl);
+		return false;
+	}
+
+	mag = kc->kc_loaded[blktype];
+	if (mag == NULL || mag->km_rounds == KMAG_ROUNDS) {
+		mag = kc->kc_prev[blktype];
+		if (mag != NULL && mag->km_rounds < KMAG_ROUNDS) {
+			kc->kc_prev[blktype] = kc->kc_loaded[blktype];
+			kc->kc_loaded[blktype] = mag;
+		}
+		else if (mag != NULL &&
+			 kmag_depot[blktype].kd_nfull >= KMAG_DEPOT_FULL) {
+			/*
+			 * Both full, and the depot has plenty: give the
+			 * previous one's blocks back to the subpage
+			 * allocator and load it, now empty. (Reading
+			 * kd_nfull unlocked is fine; it's just a hint.)
+			 */
+			kmag_spill(mag);
+			kc->kc_prev[blktype] = kc->kc_loaded[blktype];
+			kc->kc_loaded[blktype] = mag;
+		}
+		else {
+			/* Both full: swap one for an empty one */
+			kd = &kmag_depot[blktype];
+			spinlock_acquire(&kmag_depotlock);
+			mag = kd->kd_empty;
+			if (mag != NULL) {
+				kd->kd_empty = mag->km_next;
+				kd->kd_nempty--;
+				if (kc->kc_prev[blktype] != NULL) {
+					kc->kc_prev[blktype]->km_next =
+						kd->kd_full;
+					kd->kd_full = kc->kc_prev[blktype];
+					kd->kd_nfull++;
+				}
+				kc->kc_prev[blktype] = kc->kc_loaded[blktype];
+				kc->kc_loaded[blktype] = mag;
+			}
+			spinlock_release(&kmag_depotlock);
+		}
+	}
+
+	if (mag != NULL && mag->km_rounds < KMAG_ROUNDS) {
+		mag->km_blocks[mag->km_rounds] = ptr;
+		mag->km_rounds++;
+		done = true;
+	}
+	splx(spl);
+	return done;
+}
+
+/*
+ * Add an empty magazine for BLKTYPE to the depot. Magazines come
+ * straight from the subpage allocator, so this doesn't recurse.
+ */
+static
+bool
+kmag_addempty(unsigned blktype)
+{
+	struct kmag *mag;
+
+	mag = subpage_kmalloc(sizeof(*mag));
+	if (mag == NULL) {
+		return false;
+	}
+	mag->km_rounds = 0;
+
+	spinlock_acquire(&kmag_depotlock);
+	mag->km_next = kmag_depot[blktype].kd_empty;
+	kmag_depot[blktype].kd_empty = mag;
+	kmag_depot[blktype].kd_nempty++;
+	spinlock_release(&kmag_depotlock);
+	return true;
+}
+
+/*
+ * Give all the depot's magazines, and the blocks in them, back to the
+ * subpage allocator. Magazines loaded on cpus are left alone. Returns
+ * true if anything was freed.
+ */
+static
+bool
+kmag_drain(void)
+{
+	struct kmag *list = NULL, *mag;
+	unsigned i;
+
+	spinlock_acquire(&kmag_depotlock);
+	for (i=0; i<NSIZES; i++) {
+		while (kmag_depot[i].kd_full != NULL) {
+			mag = kmag_depot[i].kd_full;
+			kmag_depot[i].kd_full = mag->km_next;
+			mag->km_next = list;
+			list = mag;
+		}
+		while (kmag_depot[i].kd_empty != NULL) {
+			mag = kmag_depot[i].kd_empty;
+			kmag_depot[i].kd_empty = mag->km_next;
+			mag->km_next = list;
+			list = mag;
+		}
+		kmag_depot[i].kd_nfull = kmag_depot[i].kd_nempty = 0;
+	}
+	spinlock_release(&kmag_depotlock);
+
+	if (list == NULL) {
+		return false;
+	}
+	while (list != NULL) {
+		mag = list;
+		list = mag->km_next;
+		kmag_spill(mag);
+		if (subpage_kfree(mag)) {
+			panic("kmag_drain: stray magazine %p\n", mag);
+		}
+	}
+	return true;
+}
+
+/*
+ * Set up a new cpu's (empty) magazines. The first cpu is created
+ * before curcpu is set, so until then everything goes straight to the
+ * subpage allocator.
+ */
+void
+kmalloc_cpuinit(struct cpu *c)
+{
+	struct kmag_cpu *kc;
+	unsigned i;
+
+	kc = subpage_kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		panic("kmalloc_cpuinit: Out of memory\n");
+	}
+	for (i=0; i<NSIZES; i++) {
+		kc->kc_loaded[i] = NULL;
+		kc->kc_prev[i] = NULL;
+	}
+	c->c_kmag = kc;
+}
+
+static
+void
+kmag_printstats(void)
+{
+	unsigned i;
+
+	spinlock_acquire(&kmag_depotlock);
+	kprintf("Magazine depot (%u blocks per magazine):\n", KMAG_ROUNDS);
+	for (i=0; i<NSIZES; i++) {
+		kprintf("   size %-4lu  %u full, %u empty\n",
+			(unsigned long) sizes[i],
+			kmag_depot[i].kd_nfull, kmag_depot[i].kd_nempty);
+	}
+	spinlock_release(&kmag_depotlock);
+}
+
+//
+////////////////////////////////////////////////////////////
+
+/*
+ * Get NPAGES for a big allocation. Physically contiguous pages are
+ * preferred, because they are direct-mapped and take no TLB entries;
+ * if memory is too fragmented for that, use pages mapped into kernel
+ * virtual memory.
+ */
+static
+vaddr_t
+kmalloc_pages(unsigned long npages)
+{
+	vaddr_t address;
+
+	address = alloc_kpages(npages);
+	if (address == 0 && npages > 1) {
+		address = alloc_kvpages(npages);
+	}
+	return address;
+}
+
 void *
 kmalloc(size_t sz)
 {
+	unsigned blktype;
+	void *ptr;
+
 	if (sz>=LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
 		vaddr_t address;
 
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
-		address = alloc_kpages(npages);
+		address = kmalloc_pages(npages);
+		if (address==0 && kmag_drain()) {
+			address = kmalloc_pages(npages);
+		}
 		if (address==0) {
 			return NULL;
 		}
@@ -615,20 +1081,97 @@ kmalloc(size_t sz)
 		return (void *)address;
 	}
 
-	return subpage_kmalloc(sz);
+	blktype = blocktype(sz);
+	ptr = kmag_alloc(blktype);
+	if (ptr != NULL) {
+		return ptr;
+	}
+
+	ptr = subpage_kmalloc(sz);
+	if (ptr == NULL && kmag_drain()) {
+		ptr = subpage_kmalloc(sz);
+	}
+	return ptr;
 }
 
 void
 kfree(void *ptr)
 {
-	/*
-	 * Try subpage first; if that fails, assume it's a big allocation.
-	 */
+	int blktype;
+
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+
+	blktype = subpage_blocktype(ptr);
+	if (blktype < 0) {
+		/* Not a subpage block; it's a big allocation. */
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
+		return;
+	}
+
+	/* As in subpage_kfree, to catch uses of dangling pointers. */
+	fill_deadbeef(ptr, sizes[blktype]);
+
+	if (kmag_free(ptr, blktype)) {
+		return;
+	}
+	/* No room: get another empty magazine and try once more */
+	if (kmag_addempty(blktype) && kmag_free(ptr, blktype)) {
+		return;
+	}
+	if (subpage_kfree(ptr)) {
+		panic("kfree: subpage block %p went missing\n", ptr);
 	}
 }
 
+/*
+ * Resize a block from kmalloc. OLDSZ must be the size it was last
+ * allocated or resized with. The block stays put if it already has
+ * room (subpage blocks are rounded up to their size class, big ones
+ * to whole pages) or, for a big block, if the pages after it are
+ * free; otherwise it is moved. If out of memory, returns NULL and
+ * leaves the old block alone.
+ */
+void *
+krealloc(void *ptr, size_t oldsz, size_t newsz)
+{
+	unsigned long oldnpages, newnpages;
+	void *newptr;
+	int blktype;
+
+	if (ptr == NULL) {
+		return kmalloc(newsz);
+	}
+
+	/*
+	 * Go by what the block actually is rather than by OLDSZ. Sizes
+	 * from LARGEST_SUBPAGE_SIZE up go on whole pages, as in kmalloc.
+	 */
+	blktype = subpage_blocktype(ptr);
+	if (blktype >= 0) {
+		if (newsz < LARGEST_SUBPAGE_SIZE &&
+		    newsz <= sizes[blktype]) {
+			return ptr;
+		}
+	}
+	else if (newsz >= LARGEST_SUBPAGE_SIZE) {
+		oldnpages = (oldsz + PAGE_SIZE - 1)/PAGE_SIZE;
+		newnpages = (newsz + PAGE_SIZE - 1)/PAGE_SIZE;
+		if (newnpages <= oldnpages) {
+			return ptr;
+		}
+		if (grow_kpages((vaddr_t)ptr, oldnpages, newnpages)) {
+			return ptr;
+		}
+	}
+
+	newptr = kmalloc(newsz);
+	if (newptr == NULL) {
+		return NULL;
+	}
+	memcpy(newptr, ptr, oldsz < newsz ? oldsz : newsz);
+	kfree(ptr);
+	return newptr;
+}
@@ -0,0 +1,206 @@
+/*
+ * Kernel object caches. See <kmem_cache.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <kmem_cache.h>
+
+/*
+ * How many constructed objects a cache will hold on to. Past this,
+ * freed objects are destructed and their memory goes back to kmalloc.
+ */
+#define KMEM_CACHE_DEPTH 16
+
+struct kmem_cache {
+	const char *kc_name;
+	size_t kc_size;
+	int (*kc_ctor)(void *obj);
+	void (*kc_dtor)(void *obj);
+	struct kmem_cache *kc_next;		/* on kmem_caches */
+
+	struct spinlock kc_lock;		/* protects the rest */
+	unsigned kc_nfree;
+	void *kc_free[KMEM_CACHE_DEPTH];	/* constructed, not in use */
+
+	/* statistics */
+	unsigned kc_live;			/* handed out now */
+	unsigned kc_maxlive;
+	unsigned kc_allocs;			/* kmem_cache_alloc calls */
+	unsigned kc_hits;			/* ...satisfied from kc_free */
+	unsigned kc_fails;			/* ...that returned NULL */
+	unsigned kc_ctors;			/* objects constructed */
+	unsigned kc_dtors;			/* objects destructed */
+};
+
+/* All the caches, for kmem_cache_printstats. */
+static struct kmem_cache *kmem_caches;
+static struct spinlock kmem_cache_listlock = SPINLOCK_INITIALIZER;
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size,
+		  int (*ctor)(void *obj), void (*dtor)(void *obj))
+{
+	struct kmem_cache *kc;
+
+	KASSERT(size > 0);
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		return NULL;
+	}
+	kc->kc_name = name;
+	kc->kc_size = size;
+	kc->kc_ctor = ctor;
+	kc->kc_dtor = dtor;
+	spinlock_init(&kc->kc_lock);
+	kc->kc_nfree = 0;
+	kc->kc_live = 0;
+	kc->kc_maxlive = 0;
+	kc->kc_allocs = 0;
+	kc->kc_hits = 0;
+	kc->kc_fails = 0;
+	kc->kc_ctors = 0;
+	kc->kc_dtors = 0;
+
+	spinlock_acquire(&kmem_cache_listlock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_cache_listlock);
+
+	return kc;
+}
+
+/*
+ * Tear down an object that is leaving the cache.
+ */
+static
+void
+kmem_cache_release(struct kmem_cache *kc, void *obj)
+{
+	if (kc->kc_dtor != NULL) {
+		kc->kc_dtor(obj);
+	}
+	kfree(obj);
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *kc)
+{
+	struct kmem_cache **kcp;
+	void *obj;
+
+	spinlock_acquire(&kmem_cache_listlock);
+	for (kcp = &kmem_caches; *kcp != kc; kcp = &(*kcp)->kc_next) {
+		KASSERT(*kcp != NULL);
+	}
+	*kcp = kc->kc_next;
+	spinlock_release(&kmem_cache_listlock);
+
+	/* Nobody else can see it now, so no need to lock */
+	KASSERT(kc->kc_live == 0);
+	while (kc->kc_nfree > 0) {
+		obj = kc->kc_free[--kc->kc_nfree];
+		kmem_cache_release(kc, obj);
+	}
+	spinlock_cleanup(&kc->kc_lock);
+	kfree(kc);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	void *obj;
+	int result;
+
+	spinlock_acquire(&kc->kc_lock);
+	kc->kc_allocs++;
+	if (kc->kc_nfree > 0) {
+		obj = kc->kc_free[--kc->kc_nfree];
+		kc->kc_hits++;
+		kc->kc_live++;
+		if (kc->kc_live > kc->kc_maxlive) {
+			kc->kc_maxlive = kc->kc_live;
+		}
+		spinlock_release(&kc->kc_lock);
+		return obj;
+	}
+	spinlock_release(&kc->kc_lock);
+
+	/*
+	 * Nothing cached; make a new one. The constructor may sleep,
+	 * so this is done without the lock.
+	 */
+	obj = kmalloc(kc->kc_size);
+	if (obj != NULL && kc->kc_ctor != NULL) {
+		result = kc->kc_ctor(obj);
+		if (result) {
+			kfree(obj);
+			obj = NULL;
+		}
+	}
+
+	spinlock_acquire(&kc->kc_lock);
+	if (obj == NULL) {
+		kc->kc_fails++;
+	}
+	else {
+		kc->kc_ctors++;
+		kc->kc_live++;
+		if (kc->kc_live > kc->kc_maxlive) {
+			kc->kc_maxlive = kc->kc_live;
+		}
+	}
+	spinlock_release(&kc->kc_lock);
+
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	KASSERT(obj != NULL);
+
+	spinlock_acquire(&kc->kc_lock);
+	KASSERT(kc->kc_live > 0);
+	kc->kc_live--;
+	if (kc->kc_nfree < KMEM_CACHE_DEPTH) {
+		kc->kc_free[kc->kc_nfree++] = obj;
+		spinlock_release(&kc->kc_lock);
+		return;
+	}
+	kc->kc_dtors++;
+	spinlock_release(&kc->kc_lock);
+
+	kmem_cache_release(kc, obj);
+}
+
+void
+kmem_cache_printstats(void)
+{
+	struct kmem_cache *kc;
+	unsigned hitpct;
+
+	kprintf("Object caches:\n");
+	kprintf("%-16s %6s %6s %6s %6s %9s %5s %7s %7s %5s\n",
+		"name", "size", "live", "max", "cached", "allocs", "hit%",
+		"ctors", "dtors", "fails");
+
+	spinlock_acquire(&kmem_cache_listlock);
+	for (kc = kmem_caches; kc != NULL; kc = kc->kc_next) {
+		/*
+		 * Read the counters without kc_lock; kprintf with two
+		 * spinlocks held is more than this is worth, and a
+		 * slightly stale line does no harm.
+		 */
+		hitpct = kc->kc_allocs ?
+			(unsigned)((uint64_t)kc->kc_hits * 100 /
+				   kc->kc_allocs) : 0;
+		kprintf("%-16s %6u %6u %6u %6u %9u %4u%% %7u %7u %5u\n",
+			kc->kc_name, (unsigned)kc->kc_size, kc->kc_live,
+			kc->kc_maxlive, kc->kc_nfree, kc->kc_allocs, hitpct,
+			kc->kc_ctors, kc->kc_dtors, kc->kc_fails);
+	}
+	spinlock_release(&kmem_cache_listlock);
+}
@@ -0,0 +1,406 @@
+/*
+ * Memory-mapped files and anonymous memory. See <mmap.h>.
+ *
+ * Everything here belongs to a single address space, which belongs to
+ * a single-threaded process, so there is no locking.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <current.h>
+#include <thread.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <mmap.h>
+
+#define MR_END(mr)	((mr)->mr_base + (mr)->mr_npages * PAGE_SIZE)
+#define MR_SHAREDFILE(mr) \
+	((mr)->mr_vnode != NULL && ((mr)->mr_flags & MAP_SHARED))
+
+static
+struct mmap_region *
+mmap_region_create(unsigned npages, struct vnode *vn)
+{
+	struct mmap_region *mr;
+	unsigned i;
+
+	mr = kmalloc(sizeof(*mr));
+	if (mr == NULL) {
+		return NULL;
+	}
+	mr->mr_pages = kmalloc(npages * sizeof(paddr_t));
+	if (mr->mr_pages == NULL) {
+		kfree(mr);
+		return NULL;
+	}
+	for (i=0; i<npages; i++) {
+		mr->mr_pages[i] = 0;
+	}
+	mr->mr_npages = npages;
+	mr->mr_vnode = vn;
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+		VOP_INCOPEN(vn);
+	}
+	mr->mr_next = NULL;
+	return mr;
+}
+
+/*
+ * Read page IDX of a region in from its file, or zero it.
+ */
+static
+int
+mmap_pagein(struct mmap_region *mr, unsigned idx)
+{
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t kva;
+	int result;
+
+	kva = alloc_kpages(1);
+	if (kva == 0) {
+		return ENOMEM;
+	}
+
+	if (mr->mr_vnode == NULL) {
+		bzero((void *)kva, PAGE_SIZE);
+	}
+	else {
+		uio_kinit(&iov, &ku, (void *)kva, PAGE_SIZE,
+			  mr->mr_offset + (off_t)idx * PAGE_SIZE, UIO_READ);
+		result = VOP_READ(mr->mr_vnode, &ku);
+		if (result) {
+			free_kpages(kva);
+			return result;
+		}
+		/* Past EOF reads as zeros */
+		bzero((void *)(kva + PAGE_SIZE - ku.uio_resid), ku.uio_resid);
+	}
+
+	mr->mr_pages[idx] = KVADDR_TO_PADDR(kva);
+	RU_CHARGE(ru_pagefaults, 1);
+	return 0;
+}
+
+/*
+ * Write page IDX of a shared file mapping back, if it's dirty. The
+ * part of the page past EOF is not written; mapping doesn't extend the
+ * file.
+ */
+static
+int
+mmap_pageout(struct mmap_region *mr, unsigned idx)
+{
+	struct iovec iov;
+	struct uio ku;
+	struct stat st;
+	paddr_t pa = mr->mr_pages[idx];
+	off_t pos;
+	size_t len;
+	int result;
+
+	if (!MR_SHAREDFILE(mr) || (pa & MMAP_PG_DIRTY) == 0) {
+		return 0;
+	}
+
+	result = VOP_STAT(mr->mr_vnode, &st);
+	if (result) {
+		return result;
+	}
+	pos = mr->mr_offset + (off_t)idx * PAGE_SIZE;
+	if (pos >= st.st_size) {
+		return 0;
+	}
+	len = st.st_size - pos < PAGE_SIZE ? st.st_size - pos : PAGE_SIZE;
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(pa & PAGE_FRAME), len,
+		  pos, UIO_WRITE);
+	return VOP_WRITE(mr->mr_vnode, &ku);
+}
+
+/*
+ * Write back and free all of a region's pages, and the region.
+ */
+static
+int
+mmap_region_destroy(struct mmap_region *mr)
+{
+	unsigned i;
+	int result, ret = 0;
+
+	for (i=0; i<mr->mr_npages; i++) {
+		if (mr->mr_pages[i] == 0) {
+			continue;
+		}
+		result = mmap_pageout(mr, i);
+		if (result && ret == 0) {
+			ret = result;
+		}
+		free_kpages(PADDR_TO_KVADDR(mr->mr_pages[i] & PAGE_FRAME));
+	}
+	if (mr->mr_vnode != NULL) {
+		vfs_close(mr->mr_vnode);
+	}
+	kfree(mr->mr_pages);
+	kfree(mr);
+	return ret;
+}
+
+/*
+ * Split MR in two at VA, which must be a page boundary strictly inside
+ * it. The upper part becomes a new region following MR on the list.
+ */
+static
+int
+mmap_region_split(struct mmap_region *mr, vaddr_t va)
+{
+	struct mmap_region *upper;
+	unsigned lowpages, i;
+
+	KASSERT(va > mr->mr_base && va < MR_END(mr));
+
+	lowpages = (va - mr->mr_base) / PAGE_SIZE;
+	upper = mmap_region_create(mr->mr_npages - lowpages, mr->mr_vnode);
+	if (upper == NULL) {
+		return ENOMEM;
+	}
+	upper->mr_base = va;
+	upper->mr_prot = mr->mr_prot;
+	upper->mr_flags = mr->mr_flags;
+	upper->mr_offset = mr->mr_offset + (off_t)lowpages * PAGE_SIZE;
+	for (i=0; i<upper->mr_npages; i++) {
+		upper->mr_pages[i] = mr->mr_pages[lowpages + i];
+	}
+
+	/* The lower part keeps its (now oversized) page array */
+	mr->mr_npages = lowpages;
+	upper->mr_next = mr->mr_next;
+	mr->mr_next = upper;
+	return 0;
+}
+
+int
+mmap_create(struct addrspace *as, size_t len, int prot, int flags,
+	    struct vnode *vn, off_t offset, vaddr_t *ret)
+{
+	struct mmap_region *mr, **pp;
+	vaddr_t lo, hi, base;
+	size_t size;
+
+	KASSERT(len > 0);
+	KASSERT((offset & ~(off_t)PAGE_FRAME) == 0);
+
+	size = (len + PAGE_SIZE - 1) & PAGE_FRAME;
+	if (size < len) {
+		return ENOMEM;
+	}
+
+	/*
+	 * Find the highest gap that fits, between the top of the data
+	 * segment and as_mmaptop.
+	 */
+	base = 0;
+	lo = as->as_vbase2 + as->as_npages2 * PAGE_SIZE;
+	for (mr = as->as_mmaps; ; mr = mr->mr_next) {
+		hi = (mr != NULL) ? mr->mr_base : as->as_mmaptop;
+		if (hi >= lo && hi - lo >= size) {
+			base = hi - size;
+		}
+		if (mr == NULL) {
+			break;
+		}
+		lo = MR_END(mr);
+	}
+	if (base == 0) {
+		return ENOMEM;
+	}
+
+	mr = mmap_region_create(size / PAGE_SIZE, vn);
+	if (mr == NULL) {
+		return ENOMEM;
+	}
+	mr->mr_base = base;
+	mr->mr_prot = prot;
+	mr->mr_flags = flags;
+	mr->mr_offset = offset;
+
+	for (pp = &as->as_mmaps; *pp != NULL; pp = &(*pp)->mr_next) {
+		if ((*pp)->mr_base > base) {
+			break;
+		}
+	}
+	mr->mr_next = *pp;
+	*pp = mr;
+
+	*ret = base;
+	return 0;
+}
+
+int
+mmap_remove(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct mmap_region *mr, **pp;
+	vaddr_t end;
+	int result, ret = 0;
+
+	KASSERT((addr & ~(vaddr_t)PAGE_FRAME) == 0);
+
+	end = addr + ((len + PAGE_SIZE - 1) & PAGE_FRAME);
+	if (end <= addr) {
+		return EINVAL;
+	}
+
+	/*
+	 * Split regions that straddle either end of the range first, so
+	 * that running out of memory leaves everything still mapped.
+	 */
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (mr->mr_base < addr && addr < MR_END(mr)) {
+			result = mmap_region_split(mr, addr);
+			if (result) {
+				return result;
+			}
+			continue;
+		}
+		if (mr->mr_base < end && end < MR_END(mr)) {
+			result = mmap_region_split(mr, end);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	pp = &as->as_mmaps;
+	while (*pp != NULL) {
+		mr = *pp;
+		if (mr->mr_base >= addr && MR_END(mr) <= end) {
+			*pp = mr->mr_next;
+			result = mmap_region_destroy(mr);
+			if (result && ret == 0) {
+				ret = result;
+			}
+		}
+		else {
+			pp = &mr->mr_next;
+		}
+	}
+	return ret;
+}
+
+int
+mmap_fault(struct addrspace *as, int faulttype, vaddr_t va,
+	   paddr_t *ret, bool *writable)
+{
+	struct mmap_region *mr;
+	unsigned idx;
+	int result;
+
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (va >= mr->mr_base && va < MR_END(mr)) {
+			break;
+		}
+	}
+	if (mr == NULL) {
+		return EFAULT;
+	}
+
+	if (faulttype == VM_FAULT_READ) {
+		if (mr->mr_prot == PROT_NONE) {
+			return EFAULT;
+		}
+	}
+	else if ((mr->mr_prot & PROT_WRITE) == 0) {
+		return EFAULT;
+	}
+
+	idx = (va - mr->mr_base) / PAGE_SIZE;
+	if (mr->mr_pages[idx] == 0) {
+		result = mmap_pagein(mr, idx);
+		if (result) {
+			return result;
+		}
+	}
+	if (faulttype != VM_FAULT_READ) {
+		mr->mr_pages[idx] |= MMAP_PG_DIRTY;
+	}
+
+	*ret = mr->mr_pages[idx] & PAGE_FRAME;
+	if (MR_SHAREDFILE(mr)) {
+		/* Stay read-only until written, to catch the first store */
+		*writable = (mr->mr_pages[idx] & MMAP_PG_DIRTY) != 0;
+	}
+	else {
+		*writable = (mr->mr_prot & PROT_WRITE) != 0;
+	}
+	return 0;
+}
+
+/*
+ * Copy the regions for fork. Private and anonymous pages are copied.
+ * Shared file pages are written back instead and the child reads them
+ * in again on demand; the two processes see each other's later changes
+ * once they are written back.
+ */
+int
+mmap_copy(struct addrspace *old, struct addrspace *new)
+{
+	struct mmap_region *mr, *nmr, **tail;
+	unsigned i;
+	vaddr_t kva;
+	int result;
+
+	tail = &new->as_mmaps;
+	for (mr = old->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		nmr = mmap_region_create(mr->mr_npages, mr->mr_vnode);
+		if (nmr == NULL) {
+			return ENOMEM;
+		}
+		nmr->mr_base = mr->mr_base;
+		nmr->mr_prot = mr->mr_prot;
+		nmr->mr_flags = mr->mr_flags;
+		nmr->mr_offset = mr->mr_offset;
+		*tail = nmr;
+		tail = &nmr->mr_next;
+
+		for (i=0; i<mr->mr_npages; i++) {
+			if (mr->mr_pages[i] == 0) {
+				continue;
+			}
+			if (MR_SHAREDFILE(mr)) {
+				result = mmap_pageout(mr, i);
+				if (result) {
+					return result;
+				}
+				continue;
+			}
+			kva = alloc_kpages(1);
+			if (kva == 0) {
+				return ENOMEM;
+			}
+			memcpy((void *)kva, (void *)PADDR_TO_KVADDR(
+				       mr->mr_pages[i] & PAGE_FRAME), PAGE_SIZE);
+			nmr->mr_pages[i] = KVADDR_TO_PADDR(kva) |
+				(mr->mr_pages[i] & MMAP_PG_DIRTY);
+		}
+	}
+	return 0;
+}
+
+void
+mmap_destroyall(struct addrspace *as)
+{
+	struct mmap_region *mr;
+
+	while (as->as_mmaps != NULL) {
+		mr = as->as_mmaps;
+		as->as_mmaps = mr->mr_next;
+		/* Nobody to report a write-back error to */
+		(void)mmap_region_destroy(mr);
+	}
+}
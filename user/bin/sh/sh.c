@@ -37,6 +37,7 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -152,42 +153,27 @@ dowait(pid_t pid)
 }
 
 #ifdef WNOHANG
-/*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
- */
-static
-int
-dowaitpoll(pid_t pid)
-{
-	int status;
-	pid_t result;
-	result = waitpid(pid, &status, WNOHANG);
-	if (result<0) {
-		warn("pid %d", pid);
-	}
-	else if (result!=0) {
-		printf("pid %d: ", pid);
-		printstatus(status);
-		printf("\n");
-		return 1;
-	}
-	return 0;
-}
-
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * reap all background jobs that have exited. Asks for any child at
+ * all, so it costs one waitpid per job that finished plus one more,
+ * rather than one per job.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+	int i, status;
+	pid_t pid;
+
+	while ((pid = waitpid(WAIT_ANY, &status, WNOHANG)) > 0) {
+		printf("pid %d: ", pid);
+		printstatus(status);
+		printf("\n");
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
+				break;
 			}
 		}
 	}
@@ -311,6 +297,7 @@ docommand(char *buf)
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
+	struct rusage ru;
 
 	nargs = 0;
 	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
@@ -354,11 +341,12 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	/* the child only execs, so there's no need to copy our memory */
+	pid = vfork();
 	switch (pid) {
 		case -1:
 			/* error */
-			warn("fork");
+			warn("vfork");
 			return _MKWAIT_EXIT(255);
 		case 0:
 			/* child */
@@ -384,9 +372,10 @@ docommand(char *buf)
 		return 0;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		warn("wait4");
 		status = -1;
+		memset(&ru, 0, sizeof(ru));
 	}
 
 	if (timing) {
@@ -399,6 +388,20 @@ docommand(char *buf)
 		endsecs -= startsecs;
 		warnx("subprocess time: %lu.%09lu seconds",
 		      (unsigned long) endsecs, (unsigned long) endnsecs);
+		warnx("  user %lu.%06lu, system %lu.%06lu; "
+		      "%lu/%lu switches (vol/invol)",
+		      (unsigned long) ru.ru_utime.tv_sec,
+		      (unsigned long) ru.ru_utime.tv_usec,
+		      (unsigned long) ru.ru_stime.tv_sec,
+		      (unsigned long) ru.ru_stime.tv_usec,
+		      (unsigned long) ru.ru_nvcsw,
+		      (unsigned long) ru.ru_nivcsw);
+		warnx("  %lu/%lu faults (minor/major), "
+		      "%lu/%lu blocks (in/out)",
+		      (unsigned long) ru.ru_minflt,
+		      (unsigned long) ru.ru_majflt,
+		      (unsigned long) ru.ru_inblock,
+		      (unsigned long) ru.ru_oublock);
 	}
 
 	return status;
@@ -118,6 +118,13 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+/*
+ * vfork is like fork, but the child runs in the parent's memory, and
+ * the parent is suspended, until the child calls execv or _exit. The
+ * child must not do anything else, not even return from the function
+ * that called vfork.
+ */
+pid_t vfork(void);
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -152,8 +159,13 @@ int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev, preadv, pwritev - see sys/uio.h */
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+struct scstat;	/* in <kern/scstats.h>; ENOSYS unless the kernel counts */
+int __scstats(struct scstat *buf, unsigned ncalls);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -803,6 +803,85 @@ dobmap(const struct sfs_inode *sfi, uint32_t fileblock)
 	return 0;
 }
 
+////////////////////////////////////////////////////////////
+
+/*
+ * Fragmentation statistics. An extent is a run of file blocks that
+ * are also consecutive on disk; a file in one extent can be read
+ * sequentially without seeking. Hopping over the file's own indirect
+ * block does not break an extent, since that is where the allocator
+ * puts it.
+ */
+
+static unsigned long frag_files=0, frag_fragmented=0;
+static unsigned long frag_extents=0, frag_blocks=0;
+
+static
+void
+frag_observe(const struct sfs_inode *sfi)
+{
+	uint32_t nblocks, i, block, prev;
+	unsigned long extents;
+
+	nblocks = SFS_ROUNDUP(sfi->sfi_size, SFS_BLOCKSIZE)/SFS_BLOCKSIZE;
+	prev = 0;
+	extents = 0;
+
+	for (i=0; i<nblocks; i++) {
+		block = dobmap(sfi, i);
+		if (block == 0) {
+			/* hole; doesn't count either way */
+			continue;
+		}
+		if (prev == 0 ||
+		    !(block == prev+1 ||
+		      (block == prev+2 && prev+1 == BMAP_I(sfi, 0)))) {
+			extents++;
+		}
+		prev = block;
+		frag_blocks++;
+	}
+
+	frag_files++;
+	frag_extents += extents;
+	if (extents > 1) {
+		frag_fragmented++;
+	}
+}
+
+static
+void
+report_fragmentation(void)
+{
+	unsigned long freeblocks=0, freeruns=0, run=0, maxrun=0, per100;
+	uint32_t i;
+
+	for (i=0; i<nblocks; i++) {
+		if (bitmapdata[i/8] & (((uint8_t)1)<<(i%8))) {
+			run = 0;
+			continue;
+		}
+		if (run == 0) {
+			freeruns++;
+		}
+		run++;
+		freeblocks++;
+		if (run > maxrun) {
+			maxrun = run;
+		}
+	}
+
+	per100 = frag_extents ? (frag_blocks*100)/frag_extents : 0;
+	warnx("%lu files, %lu fragmented; %lu extents for %lu data blocks "
+	      "(%lu.%02lu blocks/extent)",
+	      frag_files, frag_fragmented, frag_extents, frag_blocks,
+	      per100/100, per100%100);
+	warnx("%lu free blocks in %lu runs; largest free run %lu blocks",
+	      freeblocks, freeruns, maxrun);
+}
+
+////////////////////////////////////////////////////////////
+
 static
 void
 dirread(struct sfs_inode *sfi, struct sfs_dir *d, unsigned nd)
@@ -1154,7 +1233,9 @@ check_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 					swapinode(&subsfi);
 					diskwrite(&subsfi, 
 						  direntries[i].sfd_ino);
+					swapinode(&subsfi);
 				}
+				frag_observe(&subsfi);
 				observe_filelink(direntries[i].sfd_ino);
 				break;
 			    case SFS_TYPE_DIR:
@@ -1266,6 +1347,7 @@ main(int argc, char **argv)
 
 	warnx("%lu blocks used (of %lu); %lu directories; %lu files",
 	      count_blocks, (unsigned long) nblocks, count_dirs, count_files);
+	report_fragmentation();
 
 	switch (badness) {
 	    case EXIT_USAGE:
@@ -0,0 +1,184 @@
+/*
+ * copybench - time system calls that move data across the user/kernel
+ * boundary in small pieces.
+ *
+ * Usage: copybench [iterations]
+ *
+ * Times, per call:
+ *    __time     - two small copyouts
+ *    open       - copyinstr of a long pathname (which doesn't exist,
+ *                 so the call fails quickly once it's copied in)
+ *    execv      - copyin of an argv with many strings; the program
+ *                 execs itself a number of times in a row
+ *
+ * The default is 1000 iterations (one tenth that many execs). Run it
+ * on two kernels to compare them; the "sc" menu command or scstat
+ * gives the kernel's own cycle counts for the same calls.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define PATHLEN    240
+#define NFILLER    60
+#define FILLERLEN  40
+#define NARGS      6	/* before the filler, in the execv run */
+
+static char path[PATHLEN + 1];
+static char filler[NFILLER][FILLERLEN + 1];
+
+static
+void
+now(unsigned long long *us)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	*us = (unsigned long long)s * 1000000ULL + ns / 1000;
+}
+
+static
+void
+report(const char *what, unsigned long n, unsigned long long start)
+{
+	unsigned long long end, us;
+
+	now(&end);
+	us = end - start;
+	printf("%-8s %8lu calls %10llu us %8llu ns/call\n",
+	       what, n, us, n ? us * 1000 / n : 0);
+}
+
+static
+void
+bench_time(unsigned long n)
+{
+	unsigned long long start;
+	unsigned long i;
+	time_t s;
+	unsigned long ns;
+
+	now(&start);
+	for (i=0; i<n; i++) {
+		__time(&s, &ns);
+	}
+	report("__time", n, start);
+}
+
+static
+void
+bench_open(unsigned long n)
+{
+	unsigned long long start;
+	unsigned long i;
+	int fd;
+
+	memset(path, 'x', PATHLEN);
+	memcpy(path, "/copybench-", 11);
+	path[PATHLEN] = 0;
+
+	now(&start);
+	for (i=0; i<n; i++) {
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			errx(1, "open: %s exists", path);
+		}
+	}
+	report("open", n, start);
+}
+
+/*
+ * Exec ourselves with COUNT execs left to go, passing the start time
+ * along, and the filler strings to give execv something to copy.
+ */
+static
+void
+reexec(const char *prog, unsigned long count, unsigned long total,
+       unsigned long long start)
+{
+	char countstr[16], totalstr[16], secstr[16], usecstr[16];
+	char *args[NARGS + NFILLER + 1];
+	unsigned i;
+
+	/* There's no strtoull, so the start time goes in two pieces */
+	snprintf(countstr, sizeof(countstr), "%lu", count);
+	snprintf(totalstr, sizeof(totalstr), "%lu", total);
+	snprintf(secstr, sizeof(secstr), "%lu",
+		 (unsigned long)(start / 1000000));
+	snprintf(usecstr, sizeof(usecstr), "%lu",
+		 (unsigned long)(start % 1000000));
+
+	args[0] = (char *)prog;
+	args[1] = (char *)"-x";
+	args[2] = countstr;
+	args[3] = totalstr;
+	args[4] = secstr;
+	args[5] = usecstr;
+	for (i=0; i<NFILLER; i++) {
+		args[NARGS + i] = filler[i];
+	}
+	args[NARGS + NFILLER] = NULL;
+
+	execv(prog, args);
+	err(1, "execv %s", prog);
+}
+
+static
+void
+makefiller(void)
+{
+	unsigned i;
+
+	for (i=0; i<NFILLER; i++) {
+		memset(filler[i], 'a' + i % 26, FILLERLEN);
+		filler[i][FILLERLEN] = 0;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *prog;
+	unsigned long n = 1000, count, total;
+	unsigned long long start;
+
+	prog = strchr(argv[0], '/') != NULL ? argv[0] : "/testbin/copybench";
+
+	if (argc >= NARGS && !strcmp(argv[1], "-x")) {
+		/* In the middle of the execv run */
+		count = atoi(argv[2]);
+		total = atoi(argv[3]);
+		start = (unsigned long long)atoi(argv[4]) * 1000000ULL
+			+ atoi(argv[5]);
+		if (argc != NARGS + NFILLER) {
+			errx(1, "execv: got %d args, expected %d",
+			     argc, NARGS + NFILLER);
+		}
+		if (count > 0) {
+			makefiller();
+			reexec(prog, count - 1, total, start);
+		}
+		report("execv", total, start);
+		return 0;
+	}
+
+	if (argc > 1) {
+		n = atoi(argv[1]);
+	}
+
+	bench_time(n);
+	bench_open(n);
+
+	if (n / 10 > 0) {
+		makefiller();
+		now(&start);
+		reexec(prog, n / 10 - 1, n / 10, start);
+	}
+	return 0;
+}
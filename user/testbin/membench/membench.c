@@ -0,0 +1,276 @@
+/*
+ * membench - measure memcpy, memmove, and bzero throughput.
+ *
+ * Usage: membench [kilobytes]
+ *
+ * For each routine, and for each of several sizes from a few bytes
+ * to 64K, moves the given amount of data (default 256K) in calls of
+ * that size, once with both buffers word-aligned and once for each of
+ * a few misalignments, and reports KB/s. A plain byte loop is timed
+ * alongside memcpy for comparison.
+ *
+ * Before timing anything, it checks each routine at all those sizes
+ * and alignments against a byte loop, including memmove with the
+ * buffers overlapping both ways, and checks that the bytes around
+ * the range are left alone.
+ *
+ * Built for the host (in hostbin), it times the same common/libc
+ * sources OS/161 uses, not the host's libc, so the numbers can be
+ * compared with the ones from inside OS/161.
+ */
+
+#ifdef HOST
+#define memcpy os161_memcpy
+#define memmove os161_memmove
+#define bzero os161_bzero
+#include "../../../common/libc/string/memcpy.c"
+#include "../../../common/libc/string/memmove.c"
+#include "../../../common/libc/string/bzero.c"
+#include "hostcompat.h"
+#endif
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MAXSIZE  65536
+#define SLOP     64
+
+static char srcbuf[MAXSIZE + SLOP];
+static char dstbuf[MAXSIZE + SLOP];
+static char refbuf[MAXSIZE + SLOP];
+
+static const size_t sizes[] = { 16, 64, 512, 4096, MAXSIZE };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* Source and destination offsets from a word boundary */
+static const struct {
+	const char *name;
+	unsigned srcoff, dstoff;
+} aligns[] = {
+	{ "aligned", 0, 0 },
+	{ "both+1", 1, 1 },
+	{ "src+1", 1, 0 },
+	{ "dst+3", 0, 3 },
+};
+#define NALIGNS (sizeof(aligns) / sizeof(aligns[0]))
+
+enum op { OP_BYTES, OP_MEMCPY, OP_MEMMOVE, OP_BZERO };
+static const char *const opnames[] = {
+	"byte loop", "memcpy", "memmove", "bzero",
+};
+
+static
+void
+byteloop(char *d, const char *s, size_t len)
+{
+	volatile char *vd = d;
+	size_t i;
+
+	/* volatile keeps the compiler from turning this into memcpy */
+	for (i=0; i<len; i++) {
+		vd[i] = s[i];
+	}
+}
+
+/*
+ * Reference memmove, a byte at a time.
+ */
+static
+void
+refmove(char *d, const char *s, size_t len)
+{
+	size_t i;
+
+	if (d < s) {
+		for (i=0; i<len; i++) {
+			d[i] = s[i];
+		}
+	}
+	else {
+		for (i=len; i>0; i--) {
+			d[i-1] = s[i-1];
+		}
+	}
+}
+
+/*
+ * Do OP with SIZE bytes both in dstbuf, with the routine under test,
+ * and in refbuf, by bytes; then compare the two from the start to
+ * SLOP past the end, which also catches stray writes. For memmove,
+ * BACKWARD puts the destination above the source, overlapping;
+ * otherwise below. Returns 0 if they match.
+ */
+static
+int
+checkone(enum op op, size_t size, unsigned srcoff, unsigned dstoff,
+	 int backward)
+{
+	size_t span = size + SLOP, i;
+	unsigned soff, doff;
+
+	for (i=0; i<span; i++) {
+		dstbuf[i] = refbuf[i] = (char)(i * 7 + 1);
+	}
+
+	switch (op) {
+	    case OP_BYTES:
+		return 0;
+	    case OP_MEMCPY:
+		memcpy(dstbuf + dstoff, srcbuf + srcoff, size);
+		refmove(refbuf + dstoff, srcbuf + srcoff, size);
+		break;
+	    case OP_MEMMOVE:
+		/* 8 apart, so the alignments stay as given */
+		soff = srcoff + (backward ? 0 : 8);
+		doff = dstoff + (backward ? 8 : 0);
+		memmove(dstbuf + doff, dstbuf + soff, size);
+		refmove(refbuf + doff, refbuf + soff, size);
+		break;
+	    case OP_BZERO:
+		bzero(dstbuf + dstoff, size);
+		for (i=0; i<size; i++) {
+			refbuf[dstoff + i] = 0;
+		}
+		break;
+	}
+
+	for (i=0; i<span; i++) {
+		if (dstbuf[i] != refbuf[i]) {
+			printf("membench: %s%s of %lu bytes, src+%u dst+%u: "
+			       "byte %lu is %d, should be %d\n",
+			       opnames[op],
+			       op != OP_MEMMOVE ? "" :
+			       backward ? " (backward)" : " (forward)",
+			       (unsigned long)size, srcoff, dstoff,
+			       (unsigned long)i, dstbuf[i], refbuf[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Check every routine at every size and alignment we time, plus one
+ * byte short of each size so the odd tails get tried too. Returns
+ * the number of failures.
+ */
+static
+unsigned
+checkall(void)
+{
+	unsigned j, k, bad = 0;
+	size_t size;
+	int short1;
+	enum op op;
+
+	for (op = OP_MEMCPY; op <= OP_BZERO; op++) {
+		for (j=0; j<NSIZES; j++) {
+			for (short1=0; short1<=1; short1++) {
+				size = sizes[j] - short1;
+				for (k=0; k<NALIGNS; k++) {
+					bad += checkone(op, size,
+							aligns[k].srcoff,
+							aligns[k].dstoff, 0);
+					if (op == OP_MEMMOVE) {
+						bad += checkone(op, size,
+							aligns[k].srcoff,
+							aligns[k].dstoff, 1);
+					}
+				}
+			}
+		}
+	}
+	return bad;
+}
+
+/*
+ * Do TOTAL bytes' worth of OP in calls of SIZE bytes; return KB/s.
+ */
+static
+unsigned long
+runone(enum op op, size_t size, unsigned srcoff, unsigned dstoff,
+       unsigned long total)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned long long us;
+	unsigned long done;
+	char *src = srcbuf + srcoff;
+	char *dst = dstbuf + dstoff;
+
+	__time(&s0, &ns0);
+	for (done = 0; done < total; done += size) {
+		switch (op) {
+		    case OP_BYTES:
+			byteloop(dst, src, size);
+			break;
+		    case OP_MEMCPY:
+			memcpy(dst, src, size);
+			break;
+		    case OP_MEMMOVE:
+			/* overlapping, so it has to copy backwards */
+			memmove(srcbuf + dstoff + 8, src, size);
+			break;
+		    case OP_BZERO:
+			bzero(dst, size);
+			break;
+		}
+	}
+	__time(&s1, &ns1);
+
+	us = (unsigned long long)(s1 - s0) * 1000000ULL;
+	us = us + ns1 / 1000 - ns0 / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	return (unsigned long)((unsigned long long)total * 1000000ULL
+			       / 1024 / us);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long total = 256 * 1024;
+	unsigned i, j, k;
+	enum op op;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	if (argc > 1) {
+		total = atoi(argv[1]) * 1024UL;
+	}
+
+	for (i=0; i<sizeof(srcbuf); i++) {
+		srcbuf[i] = (char)i;
+	}
+
+	if (checkall() > 0) {
+		printf("membench: test failed\n");
+		return 1;
+	}
+	printf("membench: memcpy, memmove, and bzero check out\n");
+
+	printf("membench: %lu KB per test, KB/s\n", total / 1024);
+	for (op = OP_BYTES; op <= OP_BZERO; op++) {
+		printf("\n%-10s", opnames[op]);
+		for (k=0; k<NALIGNS; k++) {
+			printf(" %10s", aligns[k].name);
+		}
+		printf("\n");
+		for (j=0; j<NSIZES; j++) {
+			printf("%10lu", (unsigned long)sizes[j]);
+			for (k=0; k<NALIGNS; k++) {
+				printf(" %10lu",
+				       runone(op, sizes[j], aligns[k].srcoff,
+					      aligns[k].dstoff, total));
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
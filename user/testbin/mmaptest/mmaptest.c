@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * mmaptest - test mmap and munmap.
+ *
+ * Writes a file, maps it shared and checks that the mapping shows the
+ * file's contents, changes it through the mapping and checks that the
+ * change reaches the file once it's unmapped. Then checks anonymous
+ * mappings and unmapping part of a mapping.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <err.h>
+
+#define FILENAME  "mmaptest.dat"
+#define PAGESIZE  4096
+#define NPAGES    8
+#define FILESIZE  (NPAGES * PAGESIZE - 100)	/* last page is partial */
+
+static char buf[NPAGES * PAGESIZE];
+
+static
+void
+filetest(void)
+{
+	char *p;
+	int fd, i;
+
+	for (i=0; i<FILESIZE; i++) {
+		buf[i] = (char)(i * 7);
+	}
+
+	fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	if (write(fd, buf, FILESIZE) != FILESIZE) {
+		err(1, "%s: write", FILENAME);
+	}
+
+	p = mmap(NULL, FILESIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	for (i=0; i<FILESIZE; i++) {
+		if (p[i] != buf[i]) {
+			errx(1, "Mapped file has wrong data at %d", i);
+		}
+	}
+	for (i=FILESIZE; i<NPAGES * PAGESIZE; i++) {
+		if (p[i] != 0) {
+			errx(1, "Mapped file not zeroed past EOF at %d", i);
+		}
+	}
+
+	/* Change every other page */
+	for (i=0; i<FILESIZE; i++) {
+		if ((i / PAGESIZE) % 2 == 0) {
+			p[i] = ~p[i];
+		}
+	}
+	if (munmap(p, FILESIZE) < 0) {
+		err(1, "munmap");
+	}
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "%s: lseek", FILENAME);
+	}
+	if (read(fd, buf, sizeof(buf)) != FILESIZE) {
+		errx(1, "%s: file is the wrong size after munmap", FILENAME);
+	}
+	for (i=0; i<FILESIZE; i++) {
+		char want = (char)(i * 7);
+		if ((i / PAGESIZE) % 2 == 0) {
+			want = ~want;
+		}
+		if (buf[i] != want) {
+			errx(1, "Stores through mapping lost at %d", i);
+		}
+	}
+
+	close(fd);
+	remove(FILENAME);
+	printf("mmaptest: file mapping ok\n");
+}
+
+static
+void
+anontest(void)
+{
+	char *p;
+	int i;
+
+	p = mmap(NULL, NPAGES * PAGESIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap anonymous");
+	}
+	for (i=0; i<NPAGES * PAGESIZE; i++) {
+		if (p[i] != 0) {
+			errx(1, "Anonymous memory not zeroed at %d", i);
+		}
+		p[i] = (char)i;
+	}
+
+	/* Punch a hole in the middle; the ends must survive */
+	if (munmap(p + 2 * PAGESIZE, 2 * PAGESIZE) < 0) {
+		err(1, "munmap of middle pages");
+	}
+	for (i=0; i<NPAGES * PAGESIZE; i++) {
+		if (i >= 2 * PAGESIZE && i < 4 * PAGESIZE) {
+			continue;
+		}
+		if (p[i] != (char)i) {
+			errx(1, "Anonymous memory lost at %d", i);
+		}
+	}
+	if (munmap(p, NPAGES * PAGESIZE) < 0) {
+		err(1, "munmap");
+	}
+	printf("mmaptest: anonymous mapping ok\n");
+}
+
+int
+main(void)
+{
+	filetest();
+	anontest();
+	printf("mmaptest: passed\n");
+	return 0;
+}
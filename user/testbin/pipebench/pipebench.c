@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench - measure pipe throughput.
+ *
+ * Usage: pipebench [megabytes [chunksize]]
+ *
+ * Forks; the child writes the requested amount into a pipe in
+ * chunks of the given size (default one page) and the parent reads
+ * it all back, checks it, and reports how long it took.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define MAXCHUNK 65536
+
+static char buf[MAXCHUNK];
+
+static
+void
+writer(int fd, unsigned long total, size_t chunk)
+{
+	unsigned long done;
+	size_t i, n;
+	ssize_t r;
+
+	for (done = 0; done < total; done += n) {
+		n = total - done < chunk ? total - done : chunk;
+		for (i=0; i<n; i++) {
+			buf[i] = (char)((done + i) & 0xff);
+		}
+		r = write(fd, buf, n);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != n) {
+			errx(1, "write: short count %ld of %lu",
+			     (long)r, (unsigned long)n);
+		}
+	}
+}
+
+static
+unsigned long
+reader(int fd, size_t chunk)
+{
+	unsigned long done = 0;
+	ssize_t r, i;
+
+	while (1) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i=0; i<r; i++) {
+			if (buf[i] != (char)((done + i) & 0xff)) {
+				errx(1, "Wrong data at offset %lu",
+				     done + i);
+			}
+		}
+		done += r;
+	}
+	return done;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long mb = 4, total, got;
+	size_t chunk = 4096;
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned long long us;
+	int fds[2];
+	int pid, status;
+
+	if (argc > 1) {
+		mb = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+	}
+	if (chunk == 0 || chunk > MAXCHUNK) {
+		errx(1, "Chunk size must be between 1 and %d", MAXCHUNK);
+	}
+	total = mb * 1024 * 1024;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&s0, &ns0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	got = reader(fds[0], chunk);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	__time(&s1, &ns1);
+
+	if (got != total) {
+		errx(1, "Read %lu bytes, expected %lu", got, total);
+	}
+
+	us = (unsigned long long)(s1 - s0) * 1000000ULL;
+	us = us + ns1 / 1000 - ns0 / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	printf("pipebench: %lu bytes in %lu-byte chunks, %llu us, "
+	       "%llu KB/s\n", total, (unsigned long)chunk, us,
+	       (unsigned long long)total * 1000000ULL / 1024 / us);
+	return 0;
+}
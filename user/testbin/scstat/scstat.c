@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * scstat - print the kernel's system call statistics.
+ *
+ * Usage: scstat
+ *
+ * Prints the same table as the kernel menu's "sc" command: for every
+ * call that has been used, how many calls were made and failed, their
+ * average and worst-case latency in cycles, and a histogram of the
+ * latencies. The kernel has to be built with "options scstats".
+ */
+
+#include <sys/types.h>
+#include <kern/scstats.h>
+#include <kern/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+static const char *const names[SCSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_wait4] = "wait4",
+	[SYS_getpid] = "getpid",
+	[SYS_getrusage] = "getrusage",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_preadv] = "preadv",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_pwritev] = "pwritev",
+	[SYS_lseek] = "lseek",
+	[SYS___time] = "__time",
+	[SYS_reboot] = "reboot",
+	[SYS___scstats] = "__scstats",
+};
+
+static struct scstat stats[SCSTAT_NCALLS];
+
+int
+main(void)
+{
+	unsigned long long done;
+	int n, i, j;
+
+	n = __scstats(stats, SCSTAT_NCALLS);
+	if (n < 0) {
+		err(1, "__scstats");
+	}
+
+	printf("%-12s %10s %8s %10s %10s\n",
+	       "syscall", "calls", "errors", "avg cyc", "max cyc");
+	for (i=0; i<n; i++) {
+		if (stats[i].ss_calls == 0) {
+			continue;
+		}
+		done = 0;
+		for (j=0; j<SCSTAT_NLAT; j++) {
+			done += stats[i].ss_lat[j];
+		}
+		if (names[i] != NULL) {
+			printf("%-12s", names[i]);
+		}
+		else {
+			printf("#%-11d", i);
+		}
+		printf(" %10llu %8llu %10llu %10u\n",
+		       stats[i].ss_calls, stats[i].ss_errors,
+		       done ? stats[i].ss_cycles / done : 0,
+		       stats[i].ss_maxcycles);
+
+		if (done == 0) {
+			continue;
+		}
+		printf("    latency:");
+		for (j=0; j<SCSTAT_NLAT; j++) {
+			if (stats[i].ss_lat[j] == 0) {
+				continue;
+			}
+			if (j == SCSTAT_NLAT-1) {
+				printf(" >=%u:%u", 128U << j,
+				       stats[i].ss_lat[j]);
+			}
+			else {
+				printf(" <%u:%u", 256U << j,
+				       stats[i].ss_lat[j]);
+			}
+		}
+		printf(" (cycles)\n");
+	}
+	return 0;
+}